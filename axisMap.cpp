@@ -0,0 +1,51 @@
+#include "axisMap.h"
+
+#include <numeric>
+
+void axisMap::reset(int count)
+{
+    m_ids.resize(count);
+    std::iota(m_ids.begin(),m_ids.end(),0);
+    m_pos = m_ids;
+    m_free.clear();
+}
+
+void axisMap::insert(int pos, int count)
+{
+    m_ids.insert(pos,count,-1);
+    for(int i = 0; i < count; i++)
+    {
+        if(!m_free.isEmpty())
+            m_ids[pos+i] = m_free.takeLast();
+        else
+        {
+            m_ids[pos+i] = m_pos.size();
+            m_pos.append(-1);
+        }
+    }
+    renumberFrom(pos);
+}
+
+void axisMap::remove(int pos, int count)
+{
+    for(int i = pos; i < pos+count; i++)
+    {
+        m_pos[m_ids[i]] = -1;
+        m_free.append(m_ids[i]);
+    }
+    m_ids.remove(pos,count);
+    renumberFrom(pos);
+}
+
+QVector<int> axisMap::compact()
+{
+    auto renamed = m_pos;
+    reset(m_ids.size());
+    return renamed;
+}
+
+void axisMap::renumberFrom(int pos)
+{
+    for(int i = pos; i < m_ids.size(); i++)
+        m_pos[m_ids[i]] = i;
+}
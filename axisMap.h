@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QVector>
+
+// Maps logical positions on one table axis to stable physical ids and back.
+// Cells anchor on physical ids, so inserting or removing rows/columns edits
+// this mapping instead of rewriting every Cell below the cut. Removed ids are
+// handed out again by later inserts, so undo and redo do not grow the map.
+class axisMap
+{
+public:
+    //identity mapping 0..count-1, drops every id handed out before
+    void reset(int count);
+
+    int toPhysical(int pos) const
+    {
+        if(pos < 0 || pos >= m_ids.size())
+            return -1;
+        return m_ids[pos];
+    }
+    //-1 for ids that were removed
+    int toLogical(int id) const
+    {
+        if(id < 0 || id >= m_pos.size())
+            return -1;
+        return m_pos[id];
+    }
+
+    void insert(int pos, int count);
+    void remove(int pos, int count);
+    //renumbers the ids to their positions, dropping the removed ones;
+    //returns the new id of each old one, -1 for those removed
+    QVector<int> compact();
+    int size() const { return m_ids.size(); }
+    qint64 bytes() const { return (m_ids.size()+m_pos.size()+m_free.size())*qint64(sizeof(int)); }
+
+private:
+    void renumberFrom(int pos);
+
+    QVector<int> m_ids;     //logical -> physical
+    QVector<int> m_pos;     //physical -> logical
+    QVector<int> m_free;    //removed ids, the last one is reused first
+};
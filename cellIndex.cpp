@@ -0,0 +1,96 @@
+#include "cellIndex.h"
+
+void cellIndex::reset(int rows, int cols)
+{
+    m_cols = cols;
+    m_grid.clear();
+    m_grid.resize(rows);
+}
+
+void cellIndex::clear()
+{
+    m_grid.clear();
+    m_cols = 0;
+}
+
+void cellIndex::fill(int row, int col, int rowSpan, int colSpan, int owner)
+{
+    ensureSize(row+rowSpan,col+colSpan);
+    for(int r = row; r < row+rowSpan; r++)
+    {
+        auto &line = m_grid[r];
+        if(line.isEmpty())
+        {
+            if(owner < 0)
+                continue;
+            line.fill(-1,m_cols);
+        }
+        std::fill(line.begin()+col,line.begin()+col+colSpan,owner);
+    }
+}
+
+void cellIndex::insertRows(int row, int count)
+{
+    ensureSize(row,0);
+    m_grid.insert(row,count,QVector<int>());
+}
+
+void cellIndex::removeRows(int row, int count)
+{
+    if(row >= m_grid.size())
+        return;
+    m_grid.remove(row,qMin(count,int(m_grid.size())-row));
+}
+
+void cellIndex::insertColumns(int col, int count)
+{
+    ensureSize(0,col);
+    for(auto &line : m_grid)
+    {
+        if(!line.isEmpty())
+            line.insert(col,count,-1);
+    }
+    m_cols += count;
+}
+
+void cellIndex::removeColumns(int col, int count)
+{
+    if(col >= m_cols)
+        return;
+    count = qMin(count,m_cols-col);
+    for(auto &line : m_grid)
+    {
+        if(!line.isEmpty())
+            line.remove(col,count);
+    }
+    m_cols -= count;
+}
+
+void cellIndex::releaseRows(int row, int count)
+{
+    for(int r = row; r < qMin(row+count,int(m_grid.size())); r++)
+        m_grid[r] = QVector<int>();
+}
+
+void cellIndex::ensureSize(int rows, int cols)
+{
+    if(cols > m_cols)
+    {
+        for(auto &line : m_grid)
+        {
+            if(!line.isEmpty())
+                line.resize(cols,-1);
+        }
+        m_cols = cols;
+    }
+    if(rows > m_grid.size())
+        m_grid.resize(rows);
+}
+
+qint64 cellIndex::bytes() const
+{
+    qint64 bytes = m_grid.size()*qint64(sizeof(QVector<int>));
+    for(const auto &line : m_grid)
+        bytes += line.capacity()*qint64(sizeof(int));
+    return bytes;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QVector>
+
+// Ownership grid: maps a (row,col) position to the index of the Cell in
+// TableState::cells whose rectangle covers it, -1 if nothing does.
+// One vector per row, so inserting or removing rows only moves row handles.
+// A row gets its vector once a cell covers part of it, until then it reads
+// as -1: a sparse table only pays for the rows its cells touch.
+class cellIndex
+{
+public:
+    void reset(int rows, int cols);
+    void clear();
+
+    int owner(int row, int col) const
+    {
+        if(row < 0 || row >= m_grid.size() || col < 0)
+            return -1;
+        const auto &line = m_grid[row];
+        return col < line.size() ? line[col] : -1;
+    }
+
+    //columns the row has storage for, owner() is -1 from there on
+    int rowSize(int row) const
+    {
+        return row >= 0 && row < m_grid.size() ? m_grid[row].size() : 0;
+    }
+
+    //grows the grid when the rectangle reaches past its current size.
+    //Clearing (owner -1) leaves rows without storage as they are
+    void fill(int row, int col, int rowSpan, int colSpan, int owner);
+    void insertRows(int row, int count);
+    void removeRows(int row, int count);
+    void insertColumns(int col, int count);
+    void removeColumns(int col, int count);
+    //frees the storage of rows nothing owns any more, they read as -1 until filled again
+    void releaseRows(int row, int count);
+
+    int rowCount() const { return m_grid.size(); }
+    int columnCount() const { return m_cols; }
+    //estimated memory of the grid
+    qint64 bytes() const;
+
+private:
+    void ensureSize(int rows, int cols);
+
+    QVector<QVector<int>> m_grid;
+    int m_cols = 0;
+};
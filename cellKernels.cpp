@@ -0,0 +1,120 @@
+#include "cellKernels.h"
+#include <QtAlgorithms>
+#include <climits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KERNELWIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KERNELWIDTH 4
+#else
+#define KERNELWIDTH 1
+#endif
+
+#if KERNELWIDTH == 8
+using lanes = __m256i;
+static lanes load(const int *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+static lanes splat(int v) { return _mm256_set1_epi32(v); }
+static lanes add(lanes a, lanes b) { return _mm256_add_epi32(a,b); }
+static lanes greater(lanes a, lanes b) { return _mm256_cmpgt_epi32(a,b); }
+static lanes both(lanes a, lanes b) { return _mm256_and_si256(a,b); }
+static lanes either(lanes a, lanes b) { return _mm256_or_si256(a,b); }
+static lanes maximum(lanes a, lanes b) { return _mm256_max_epi32(a,b); }
+static int mask(lanes a) { return _mm256_movemask_ps(_mm256_castsi256_ps(a)); }
+static void store(int *p, lanes a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),a); }
+#elif KERNELWIDTH == 4
+using lanes = __m128i;
+static lanes load(const int *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+static lanes splat(int v) { return _mm_set1_epi32(v); }
+static lanes add(lanes a, lanes b) { return _mm_add_epi32(a,b); }
+static lanes greater(lanes a, lanes b) { return _mm_cmpgt_epi32(a,b); }
+static lanes both(lanes a, lanes b) { return _mm_and_si128(a,b); }
+static lanes either(lanes a, lanes b) { return _mm_or_si128(a,b); }
+//SSE2 has no signed max
+static lanes maximum(lanes a, lanes b)
+{
+    auto gt = _mm_cmpgt_epi32(a,b);
+    return _mm_or_si128(_mm_and_si128(gt,a),_mm_andnot_si128(gt,b));
+}
+static int mask(lanes a) { return _mm_movemask_ps(_mm_castsi128_ps(a)); }
+static void store(int *p, lanes a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p),a); }
+#endif
+
+//append base+bit for every bit set in m
+static void appendLanes(QList<int> &out, int base, int m)
+{
+    while(m)
+    {
+        out.append(base + qCountTrailingZeroBits(uint(m)));
+        m &= m-1;
+    }
+}
+
+int maxEnd(const int *pos, const int *span, qsizetype n)
+{
+    int result = 0;
+    qsizetype i = 0;
+#if KERNELWIDTH > 1
+    if(n >= KERNELWIDTH)
+    {
+        auto best = splat(0);
+        for(; i + KERNELWIDTH <= n; i += KERNELWIDTH)
+            best = maximum(best,add(load(pos+i),load(span+i)));
+        int lane[KERNELWIDTH];
+        store(lane,best);
+        for(auto v : lane)
+            result = qMax(result,v);
+    }
+#endif
+    for(; i < n; i++)
+        result = qMax(result,pos[i]+span[i]);
+    return result;
+}
+
+void selectMerged(const int *rowSpan, const int *colSpan, qsizetype n, QList<int> &out)
+{
+    qsizetype i = 0;
+#if KERNELWIDTH > 1
+    auto one = splat(1);
+    for(; i + KERNELWIDTH <= n; i += KERNELWIDTH)
+    {
+        auto m = mask(either(greater(load(rowSpan+i),one),greater(load(colSpan+i),one)));
+        appendLanes(out,i,m);
+    }
+#endif
+    for(; i < n; i++)
+    {
+        if(rowSpan[i] > 1 || colSpan[i] > 1)
+            out.append(i);
+    }
+}
+
+void selectAnchored(const int *row, const int *col, qsizetype n,
+                    int top, int left, int bottom, int right, QList<int> &out)
+{
+    qsizetype i = 0;
+#if KERNELWIDTH > 1
+    //top <= v <= bottom as v > top-1 and bottom+1 > v, without overflowing at the limits
+    if(top > INT_MIN && left > INT_MIN && bottom < INT_MAX && right < INT_MAX)
+    {
+        auto above = splat(top-1);
+        auto below = splat(bottom+1);
+        auto before = splat(left-1);
+        auto after = splat(right+1);
+        for(; i + KERNELWIDTH <= n; i += KERNELWIDTH)
+        {
+            auto r = load(row+i);
+            auto c = load(col+i);
+            auto inside = both(both(greater(r,above),greater(below,r)),
+                               both(greater(c,before),greater(after,c)));
+            appendLanes(out,i,mask(inside));
+        }
+    }
+#endif
+    for(; i < n; i++)
+    {
+        if(row[i] >= top && row[i] <= bottom && col[i] >= left && col[i] <= right)
+            out.append(i);
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QList>
+
+// Scans over the int columns of a cellStore. Built with AVX2 when the compiler
+// targets it (MERGETABLE_AVX2), SSE2 on any other x86-64, scalar elsewhere.
+
+//largest pos+span, 0 for no cells
+int maxEnd(const int *pos, const int *span, qsizetype n);
+//positions of the cells spanning more than one row or column
+void selectMerged(const int *rowSpan, const int *colSpan, qsizetype n, QList<int> &out);
+//positions of the cells anchored inside rows top..bottom and columns left..right
+void selectAnchored(const int *row, const int *col, qsizetype n,
+                    int top, int left, int bottom, int right, QList<int> &out);
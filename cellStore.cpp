@@ -0,0 +1,158 @@
+#include "cellStore.h"
+#include <QAtomicInteger>
+
+//shared by every store, a handle from one never matches a cell of another.
+//64 bits do not wrap in the life of a process
+static QAtomicInteger<quint64> g_generation;
+
+void cellStore::reserve(qsizetype n)
+{
+    m_row.reserve(n);
+    m_col.reserve(n);
+    m_rowSpan.reserve(n);
+    m_colSpan.reserve(n);
+    m_id.reserve(n);
+    m_val.reserve(n);
+    m_slot.reserve(n);
+}
+
+void cellStore::clear()
+{
+    m_row.clear();
+    m_col.clear();
+    m_rowSpan.clear();
+    m_colSpan.clear();
+    m_id.clear();
+    m_val.clear();
+    m_values.clear();
+    m_slot.clear();
+    m_slotPos.clear();
+    m_gens.clear();
+    m_freeSlots.clear();
+}
+
+//new cells are 1x1 at (0,0) with no id and no value
+void cellStore::resize(qsizetype n)
+{
+    while(size() > n)
+        removeLast();
+    auto old = size();
+    m_row.resize(n);
+    m_col.resize(n);
+    m_rowSpan.resize(n,1);
+    m_colSpan.resize(n,1);
+    m_id.resize(n,-1);
+    if(n == old)
+        return;
+    //all share one empty value
+    auto empty = m_values.intern(QString());
+    m_values.retain(empty,n-old-1);
+    m_val.resize(n,empty);
+    for(auto i = old; i < n; i++)
+        takeSlot();
+}
+
+void cellStore::append(const Cell &cell)
+{
+    m_row.append(cell.row);
+    m_col.append(cell.col);
+    m_rowSpan.append(cell.rowSpan);
+    m_colSpan.append(cell.colSpan);
+    m_id.append(cell.id);
+    m_val.append(m_values.intern(cell.val));
+    takeSlot();
+}
+
+void cellStore::removeLast()
+{
+    auto val = m_val.last();
+    freeSlot(m_slot.takeLast());
+    m_row.removeLast();
+    m_col.removeLast();
+    m_rowSpan.removeLast();
+    m_colSpan.removeLast();
+    m_id.removeLast();
+    m_val.removeLast();
+    releaseVal(val);
+}
+
+void cellStore::removeAt(qsizetype i)
+{
+    auto last = size()-1;
+    if(i != last)
+    {
+        auto slot = m_slot.at(i);
+        m_row[i] = m_row.at(last);
+        m_col[i] = m_col.at(last);
+        m_rowSpan[i] = m_rowSpan.at(last);
+        m_colSpan[i] = m_colSpan.at(last);
+        m_id[i] = m_id.at(last);
+        //swap the value ids, the one removed is released with the last cell
+        std::swap(m_val[i],m_val[last]);
+        m_slot[i] = m_slot.at(last);
+        m_slotPos[m_slot.at(i)] = i;
+        m_slot[last] = slot;
+        m_slotPos[slot] = last;
+    }
+    removeLast();
+}
+
+void cellStore::setVal(qsizetype i, const QString &val)
+{
+    auto old = m_val.at(i);
+    m_val[i] = m_values.intern(val);
+    releaseVal(old);
+}
+
+void cellStore::holdVal(qsizetype i, const QString &val)
+{
+    auto old = m_val.at(i);
+    m_val[i] = m_values.hold(val);
+    releaseVal(old);
+}
+
+//renumbering touches every cell, so it waits until most of the pool is free
+void cellStore::releaseVal(int id)
+{
+    m_values.release(id);
+    if(!m_values.wasteful())
+        return;
+    auto remap = m_values.compact();
+    for(auto &val : m_val)
+        val = remap.at(val);
+}
+
+Cell cellStore::at(qsizetype i) const
+{
+    Cell cell;
+    cell.val = val(i);
+    cell.rowSpan = m_rowSpan.at(i);
+    cell.colSpan = m_colSpan.at(i);
+    cell.row = m_row.at(i);
+    cell.col = m_col.at(i);
+    cell.id = m_id.at(i);
+    return cell;
+}
+
+//a slot for the cell just appended
+void cellStore::takeSlot()
+{
+    int slot;
+    if(!m_freeSlots.isEmpty())
+        slot = m_freeSlots.takeLast();
+    else
+    {
+        slot = m_slotPos.size();
+        m_slotPos.append(-1);
+        m_gens.append(0);
+    }
+    m_slotPos[slot] = m_slot.size();
+    m_gens[slot] = g_generation.fetchAndAddRelaxed(1);
+    m_slot.append(slot);
+}
+
+void cellStore::freeSlot(int slot)
+{
+    m_slotPos[slot] = -1;
+    m_freeSlots.append(slot);
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <QVector>
+#include <QString>
+#include "valuePool.h"
+#include <type_traits>
+
+struct Cell{
+    QString val = QStringLiteral("temp");
+    // int row;
+    // int column;
+    int rowSpan = 1;
+    int colSpan = 1;
+    //physical ids of the top-left corner, TableState::rowMap/colMap give the position
+    int row;
+    int col;
+    int id = -1;    //database row id, follows the cell through every edit
+
+    bool operator==(const Cell&temp) const
+    {
+        return this->rowSpan == temp.rowSpan && this->colSpan == temp.colSpan &&
+               this->col == temp.col && this->row == temp.row && this->val == temp.val;
+    }
+};
+
+//names a stored cell for as long as it exists, whatever is added or removed
+//around it. Generations are never reused, so a stale handle finds nothing
+//even in another table state
+struct cellHandle {
+    int slot = -1;
+    quint64 gen = 0;
+
+    bool isNull() const { return slot < 0; }
+    bool operator==(const cellHandle &other) const { return slot == other.slot && gen == other.gen; }
+    bool operator!=(const cellHandle &other) const { return !(*this == other); }
+};
+
+class cellStore;
+
+//a cell inside a cellStore, reading and writing its fields in place.
+//Like a Cell& it is invalidated by appending to the store
+struct cellRef {
+    //the value, interned in the store's pool
+    struct value {
+        cellStore &store;
+        qsizetype i;
+        operator QString() const;
+        value &operator=(const QString &val);
+        value &operator=(const value &other) { return *this = QString(other); }
+    };
+    value val;
+    int &rowSpan;
+    int &colSpan;
+    int &row;
+    int &col;
+    int &id;
+
+    operator Cell() const
+    {
+        Cell cell;
+        cell.val = val;
+        cell.rowSpan = rowSpan;
+        cell.colSpan = colSpan;
+        cell.row = row;
+        cell.col = col;
+        cell.id = id;
+        return cell;
+    }
+    cellRef &operator=(const Cell &cell)
+    {
+        val = cell.val;
+        rowSpan = cell.rowSpan;
+        colSpan = cell.colSpan;
+        row = cell.row;
+        col = cell.col;
+        id = cell.id;
+        return *this;
+    }
+    cellRef &operator=(const cellRef &other)
+    {
+        return *this = Cell(other);
+    }
+};
+
+// The cells of a table stored field by field: scans over the geometry stream
+// through contiguous int arrays without touching the values, and each cell
+// holds its value as an id into a valuePool. Cells are addressed by position,
+// m_index and m_byId refer to them that way.
+class cellStore
+{
+public:
+    qsizetype size() const { return m_id.size(); }
+    bool isEmpty() const { return m_id.isEmpty(); }
+    void reserve(qsizetype n);
+    void clear();
+    void resize(qsizetype n);
+    void append(const Cell &cell);
+    void removeLast();
+    //moves the last cell into i, its handle follows it
+    void removeAt(qsizetype i);
+
+    cellHandle handle(qsizetype i) const { return {m_slot.at(i),m_gens.at(m_slot.at(i))}; }
+    //position of the cell, -1 once it was removed
+    qsizetype indexOf(cellHandle handle) const
+    {
+        if(handle.slot < 0 || handle.slot >= m_slotPos.size() || m_gens.at(handle.slot) != handle.gen)
+            return -1;
+        return m_slotPos.at(handle.slot);
+    }
+
+    Cell at(qsizetype i) const;
+    Cell operator[](qsizetype i) const { return at(i); }
+    cellRef operator[](qsizetype i)
+    {
+        return {{*this,i},m_rowSpan[i],m_colSpan[i],m_row[i],m_col[i],m_id[i]};
+    }
+
+    //the columns, for scans
+    const int *rows() const { return m_row.constData(); }
+    const int *cols() const { return m_col.constData(); }
+    const int *rowSpans() const { return m_rowSpan.constData(); }
+    const int *colSpans() const { return m_colSpan.constData(); }
+    const int *ids() const { return m_id.constData(); }
+    const QString &val(qsizetype i) const { return m_values.value(m_val.at(i)); }
+    void setVal(qsizetype i, const QString &val);
+    //keeps val as it is, outside the pool's lookup: for values pointing into
+    //a mapped file, interned once an edit replaces them
+    void holdVal(qsizetype i, const QString &val);
+    //same value, by id: only meaningful within one store, held values never match
+    bool sameVal(qsizetype i, qsizetype j) const { return m_val.at(i) == m_val.at(j); }
+    int distinctValues() const { return m_values.size(); }
+    //estimated memory: geometry and handles, and the pooled values
+    qint64 cellBytes() const
+    {
+        return size()*qint64(6*sizeof(int)) + (m_slot.size()+m_slotPos.size()+m_freeSlots.size())*qint64(sizeof(int))
+               + m_gens.size()*qint64(sizeof(quint64));
+    }
+    qint64 valueBytes() const { return m_values.bytes(); }
+
+    //range-for gives Cell copies, or cellRefs on a non-const store
+    template<typename Store, typename Value>
+    class iter
+    {
+    public:
+        iter(Store *store, qsizetype i) : m_store(store), m_i(i) {}
+        Value operator*() const
+        {
+            if constexpr(std::is_const_v<Store>)
+                return m_store->at(m_i);
+            else
+                return (*m_store)[m_i];
+        }
+        iter &operator++() { ++m_i; return *this; }
+        bool operator!=(const iter &other) const { return m_i != other.m_i; }
+    private:
+        Store *m_store;
+        qsizetype m_i;
+    };
+    iter<const cellStore,Cell> begin() const { return {this,0}; }
+    iter<const cellStore,Cell> end() const { return {this,size()}; }
+    iter<cellStore,cellRef> begin() { return {this,0}; }
+    iter<cellStore,cellRef> end() { return {this,size()}; }
+
+private:
+    void releaseVal(int id);
+    void takeSlot();
+    void freeSlot(int slot);
+
+    QVector<int> m_row;
+    QVector<int> m_col;
+    QVector<int> m_rowSpan;
+    QVector<int> m_colSpan;
+    QVector<int> m_id;
+    QVector<int> m_val;     //ids into m_values
+    valuePool m_values;
+    //slot map behind the handles
+    QVector<int> m_slot;        //position -> slot
+    QVector<int> m_slotPos;     //slot -> position, -1 when free
+    QVector<quint64> m_gens;    //generation of the cell in each slot
+    QVector<int> m_freeSlots;
+};
+
+inline cellRef::value::operator QString() const
+{
+    return store.val(i);
+}
+
+inline cellRef::value &cellRef::value::operator=(const QString &val)
+{
+    store.setVal(i,val);
+    return *this;
+}
@@ -0,0 +1,61 @@
+#include "ingestQueue.h"
+
+ingestQueue::ingestQueue()
+    : m_head(&m_stub)
+    , m_tail(&m_stub)
+{
+}
+
+ingestQueue::~ingestQueue()
+{
+    IngestUpdate update;
+    while(pop(update))
+        ;
+}
+
+void ingestQueue::push(IngestUpdate update)
+{
+    auto node = new Node;
+    node->update = std::move(update);
+    pushNode(node);
+}
+
+void ingestQueue::pushNode(Node *node)
+{
+    node->next.storeRelaxed(nullptr);
+    auto prev = m_head.fetchAndStoreAcquireRelease(node);
+    prev->next.storeRelease(node);
+}
+
+bool ingestQueue::pop(IngestUpdate &update)
+{
+    auto tail = m_tail;
+    auto next = tail->next.loadAcquire();
+    if(tail == &m_stub)
+    {
+        if(!next)
+            return false;
+        m_tail = next;
+        tail = next;
+        next = next->next.loadAcquire();
+    }
+    if(next)
+    {
+        m_tail = next;
+        update = std::move(tail->update);
+        delete tail;
+        return true;
+    }
+    //tail is the last node linked: unless a producer is still linking one
+    //behind it, put the stub back so tail can be taken
+    if(tail != m_head.loadAcquire())
+        return false;
+    pushNode(&m_stub);
+    next = tail->next.loadAcquire();
+    if(!next)
+        return false;
+    m_tail = next;
+    update = std::move(tail->update);
+    delete tail;
+    return true;
+}
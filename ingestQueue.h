@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QString>
+#include <QAtomicPointer>
+
+//a value for one position, from whichever thread produced it
+struct IngestUpdate {
+    int row = 0;
+    int col = 0;
+    QString val;
+};
+
+// Unbounded queue many threads push into and one thread drains, without locks:
+// a producer swaps its node in as the head and then links it behind the old one.
+// Until that link lands the consumer sees the queue end early and picks the
+// rest up on its next drain.
+class ingestQueue
+{
+public:
+    ingestQueue();
+    ~ingestQueue();
+    ingestQueue(const ingestQueue &) = delete;
+    ingestQueue &operator=(const ingestQueue &) = delete;
+
+    //any thread
+    void push(IngestUpdate update);
+    //the consumer thread only; false once nothing more can be taken now
+    bool pop(IngestUpdate &update);
+
+private:
+    struct Node {
+        IngestUpdate update;
+        QAtomicPointer<Node> next;
+    };
+    void pushNode(Node *node);
+
+    QAtomicPointer<Node> m_head;    //last node pushed
+    Node *m_tail;                   //next node to take, consumer only
+    Node m_stub;                    //keeps the list from ever being empty
+};
@@ -1,10 +1,14 @@
 #include "mergeTable.h"
+#include "tableTrace.h"
+#include "sqliteBackend.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    tableTrace::startFromEnvironment();
+    sqliteBackend::install();
     mergeTable w;
     w.show();
     return a.exec();
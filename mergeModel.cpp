@@ -1,48 +1,34 @@
 #include "mergeModel.h"
-#include <QSqlQuery>
-#include <QSqlError>
-#include <QIODevice>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QFile>
+#include "tableDiff.h"
+#include "tableIO.h"
+#include "tableFile.h"
+#include "cellKernels.h"
+#include "tableBackend.h"
+#include "tableTrace.h"
+#include <QPromise>
 #include <QSize>
+#include <climits>
 
 mergeModel::mergeModel(QObject *parent):QAbstractTableModel(parent)
 {
-    m_db = QSqlDatabase::addDatabase("QSQLITE");
-    m_db.setDatabaseName("cell.db");
-    if(!m_db.open())
-    {
-        qDebug() << "Falied to open database!"<<m_db.lastError().text() ;
-    }
+    m_ioPool.setMaxThreadCount(1);
+    m_ingestTimer.setSingleShot(true);
+    m_ingestTimer.setInterval(INGESTFRAME);
+    connect(&m_ingestTimer,&QTimer::timeout,this,&mergeModel::drainIngest);
 }
 
+mergeModel::~mergeModel() = default;
+
+//an empty table keeps reporting a single row and column
 int mergeModel::rowCount(const QModelIndex &parent) const
 {
-    int maxRows = 0;
-
-    for(auto &&cell : m_state.cells)
-    {
-        auto spanEndRow = cell.row+cell.rowSpan-1;
-        if(spanEndRow > maxRows)
-            maxRows = spanEndRow;
-    }
-    return maxRows + 1;
+    return qMax(m_state.rowMap.size(),1);
 }
 
 
 int mergeModel::columnCount(const QModelIndex &parent) const
 {
-    int maxCols = 0;
-
-    for(auto &&cell : m_state.cells)
-    {
-        auto spanEndCol = cell.col + cell.colSpan-1;
-        if(spanEndCol > maxCols)
-            maxCols = spanEndCol;
-    }
-    return maxCols+1;
+    return qMax(m_state.colMap.size(),1);
 }
 
 QVariant mergeModel::data(const QModelIndex &index, int role) const
@@ -54,16 +40,21 @@ QVariant mergeModel::data(const QModelIndex &index, int role) const
 
     if(role == Qt::DisplayRole || role == Qt::EditRole)
     {
-        auto row = index.row();
-        auto col = index.column();
-        for(auto &&cell : m_state.cells)
+        if(m_paged)
+            m_pageFocus = index.row();
+        auto i = m_index.owner(index.row(),index.column());
+        if(i >= 0)
         {
-            if(row >= cell.row && row < cell.row+cell.rowSpan &&
-                col >= cell.col && col < cell.col+cell.colSpan)
-            {
-                return cell.val;
-            }
+            const auto &val = m_state.cells.val(i);
+            //values still in a mapped file are copied out, the view may keep them longer
+            if(m_file && m_file->maps(val))
+                return QString(val.constData(),val.size());
+            return val;
         }
+        if(isImplicit(index.row(),index.column()))
+            return QStringLiteral(CELLDEFAULT);
+        if(m_paged)
+            requestBand(index.row());
     }else if(role == Qt::CheckStateRole)
         return QVariant();
 
@@ -77,23 +68,30 @@ Qt::ItemFlags mergeModel::flags(const QModelIndex &index) const
 
 bool mergeModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
+    TRACE_SCOPE("setData");
     if(!index.isValid())
         return false;
     auto row = index.row();
     auto col = index.column();
 
+    if(role == Qt::EditRole && offThread(false))
+    {
+        post([=](mergeModel &engine){ engine.setData(engine.index(row,col),value,role); });
+        return true;
+    }
     if(role == Qt::EditRole)
     {
-        saveCurrentState();
-        for(auto &&cell : m_state.cells)
-        {
-            if(cell.row == row && cell.col == col)
-            {
-                cell.val = value.toString();
-                emit dataChanged(index,index,{role});
-                return true;
-            }
-        }
+        auto cell = find(row,col);
+        if(!cell && !isImplicit(row,col))
+            return false;
+        TableCommand cmd;
+        cmd.type = TableCommand::SetValue;
+        cmd.row = row;
+        cmd.col = col;
+        cmd.before = cell ? QString(cell->val) : QStringLiteral(CELLDEFAULT);
+        cmd.after = value.toString();
+        runCommand(cmd);
+        return true;
     }
     return false;
 }
@@ -105,713 +103,2590 @@ QSize mergeModel::span(const QModelIndex &index) const
 
     auto row = index.row();
     auto col = index.column();
-
-    for(auto &&cell : m_state.cells)
-    {
-        if(cell.col== col && cell.row == row)
-        {
-            return QSize(cell.rowSpan,cell.rowSpan);
-        }
-    }
+    auto i = m_index.owner(row,col);
+    const auto &cells = m_state.cells;
+    if(i >= 0 && cells.rows()[i] == m_state.rowMap.toPhysical(row) && cells.cols()[i] == m_state.colMap.toPhysical(col))
+        return QSize(cells.colSpans()[i],cells.rowSpans()[i]);
 
     return QSize(1,1);
 }
 
+//write only what changed since the last save or load
 bool mergeModel::savetoDb(const QString &tableName)
 {
-    if(!m_db.isOpen())
-    {
-        qDebug() << "database open failed";
+    TRACE_SCOPE("savetoDb");
+    m_ioPool.waitForDone();
+    publishEngine();
+    auto db = backend(tableName);
+    if(!db)
         return false;
-    }
-
-    QSqlQuery query;
-    m_db.transaction();
-
-    query.prepare(QString("DELETE FROM %1").arg(tableName));
-    if (!query.exec()) {
-        qDebug() << "Failed to clear table:" << query.lastError();
+    bool full = fullSave(tableName);
+    if(full && !fetchAll())
         return false;
-    }
-
-    // Insert each row into the database
-    QString insertQueryStr = QString("INSERT INTO %1 (value, row, col, rowSpan,colSpan) "
-                                     "VALUES (:value, :row, :col, :rowSpan, :colSpan)").arg(tableName);
-    query.prepare(insertQueryStr);
-    for(auto &&cell : m_state.cells)
+    QList<int> dirty;
+    auto journal = takeJournal(tableName,full,dirty);
+    if(!writeSnapshot(*db,m_state,journal,dirty,{}))
     {
-        query.bindValue(":value",cell.val);
-        query.bindValue(":row",cell.row);
-        query.bindValue(":col",cell.col);
-        query.bindValue(":rowSpan",cell.rowSpan);
-        query.bindValue(":colSpan",cell.colSpan);
-        qDebug() << query.lastQuery();
-
-        if(!query.exec())
-        {
-            qDebug() << "Failed to insert row:" << query.lastError();
-            m_db.rollback(); // Rollback the transaction on failure
-            return false;
-        }
+        m_journal.full = true;
+        return false;
     }
-
-    // Commit the transaction
-    m_db.commit();
-
-    qDebug() << "Data saved to database successfully.";
+    qCDebug(lcIO) << "Data saved to database successfully.";
     return true;
 }
 
 bool mergeModel::loadFromDb(const QString &tableName)
 {
-    if(!m_db.isOpen())
-    {
-        qDebug() << "db not open!";
-        return false;
-    }
-    m_state.cells.clear();
-
-    QSqlQuery query;
-    QString selectStr = QString("SELECT value, row, col, rowSpan, colSpan FROM %1").arg(tableName);
-    query.prepare(selectStr);
-
-    if(!query.exec())
-    {
-        qDebug() << "Failed to select: "<<query.lastError().text();
+    TRACE_SCOPE("loadFromDb");
+    m_ioPool.waitForDone();
+    publishEngine();
+    auto db = backend(tableName);
+    TableState next;
+    if(!db || !db->read(next))
         return false;
-    }
-
-    beginResetModel();
-
-    while(query.next())
-    {
-        Cell cell;
-        cell.val = query.value("value").toString();
-        cell.row = query.value("row").toInt();
-        cell.col = query.value("col").toInt();
-        cell.rowSpan = query.value("rowSpan").toInt();
-        cell.colSpan = query.value("colSpan").toInt();
-        m_state.cells.append(cell);
-    }
-
-    endResetModel();
+    installState(next,tableName);
     this->printTable();
 
     // emit dataChanged(index(0,0),index(this->rowCount()-1,this->columnCount()-1));
-    qDebug() << "Load from database successful";
+    qCDebug(lcIO) << "Load from database successful";
     return true;
 }
 
 void mergeModel::savetoJson(const QString &fileName)
 {
-    QJsonArray cellArray;
-
-    for (const Cell &cell : m_state.cells) {
-        QJsonObject cellObject;
-        cellObject["row"] = cell.row;
-        cellObject["col"] = cell.col;
-        cellObject["rowSpan"] = cell.rowSpan;
-        cellObject["colSpan"] = cell.colSpan;
-        cellObject["val"] = cell.val;
+    TRACE_SCOPE("savetoJson");
+    jsonBackend backend(fileName);
+    save(backend);
+}
 
-        cellArray.append(cellObject);
-    }
+void mergeModel::loadFromJson(const QString &fileName)
+{
+    TRACE_SCOPE("loadFromJson");
+    jsonBackend backend(fileName);
+    load(backend);
+}
 
-    QJsonObject tableObject;
-    tableObject["cells"] = cellArray;
+bool mergeModel::savetoBinary(const QString &fileName)
+{
+    TRACE_SCOPE("savetoBinary");
+    binaryBackend backend(fileName);
+    return save(backend);
+}
 
-    QJsonDocument doc(tableObject);
+//the cells point into the mapped file until edited, no value is read before data() needs it
+bool mergeModel::loadFromBinary(const QString &fileName)
+{
+    TRACE_SCOPE("loadFromBinary");
+    binaryBackend backend(fileName);
+    if(!load(backend))
+        return false;
+    qCDebug(lcIO) << "Load from" << fileName << "successful";
+    return true;
+}
 
-    QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qWarning("Couldn't open file for writing.");
-        return;
-    }
+//a whole table from a backend, swapped in like any load
+bool mergeModel::load(tableBackend &backend)
+{
+    TRACE_SCOPE("load");
+    m_ioPool.waitForDone();
+    publishEngine();
+    TableState next;
+    if(!backend.read(next))
+        return false;
+    installState(next,QString(),backend.file());
+    return true;
+}
 
-    file.write(doc.toJson());
-    file.close();
+bool mergeModel::save(tableBackend &backend)
+{
+    TRACE_SCOPE("save");
+    m_ioPool.waitForDone();
+    publishEngine();
+    if(!fetchAll())
+        return false;
+    return backend.write(m_state);
 }
 
-void mergeModel::loadFromJson(const QString &fileName)
+void mergeModel::setDatabaseFile(const QString &fileName)
 {
-    QFile file(fileName);
-    if(!file.open(QIODevice::ReadOnly))
-    {
-        qDebug() << "Open json file failed!";
+    if(fileName == m_dbFile)
         return;
-    }
-
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    QJsonObject tableObj = doc.object();
-
-    beginResetModel();
-
-    auto cellArray = tableObj["cells"].toArray();
-    m_state.cells.clear();
+    //a paged table still reads its bands from the old file
+    if(m_paged && !fetchAll())
+        return;
+    m_tables.clear();
+    m_pageBackend.reset();
+    m_dbFile = fileName;
+}
 
-    for(auto &&element:cellArray)
+//opened on first use and kept with its connection until the database file
+//changes, so a model that never touches the database needs none
+std::shared_ptr<tableBackend> mergeModel::backend(const QString &tableName)
+{
+    auto &backend = m_tables[tableName];
+    if(!backend)
+        backend = tableBackend::forTable(m_dbFile,tableName);
+    if(!backend)
     {
-        auto obj = element.toObject();
-        Cell cell;
-        cell.row = obj["row"].toInt();
-        cell.col = obj["col"].toInt();
-        cell.val = obj["val"].toString();
-        cell.colSpan = obj["colSpan"].toInt();
-        cell.rowSpan = obj["rowSpan"].toInt();
-        m_state.cells.append(cell);
+        m_tables.remove(tableName);
+        qCWarning(lcIO) << "No database backend for" << tableName;
+        return {};
     }
+    return backend;
+}
 
-    endResetModel();
+//QFuture progress is an int, so it is reported in steps of the total
+#define PROGRESSSTEPS 1000
 
-    file.close();
+static ioProgress promiseProgress(QPromise<bool> &promise)
+{
+    promise.setProgressRange(0,PROGRESSSTEPS);
+    return [&promise](qint64 done, qint64 total) {
+        promise.setProgressValue(total > 0 ? int(done*PROGRESSSTEPS/total) : PROGRESSSTEPS);
+        return !promise.isCanceled();
+    };
+}
 
+//estimated memory of a table state
+static qint64 stateBytes(const TableState &state)
+{
+    return state.cells.cellBytes() + state.cells.valueBytes()
+           + state.rowMap.bytes() + state.colMap.bytes()
+           + state.mergedCells.size()*qint64(sizeof(QPair<int,int>));
 }
 
-void mergeModel::restoreTableMergeState(bool init)
+QFuture<bool> mergeModel::savetoDbAsync(const QString &tableName)
 {
-    if(init)
-    {
-        for(auto &&cell:m_state.cells)
-        {
-            if(cell.colSpan > 1 || cell.rowSpan > 1)
-                m_state.mergedCells.append({cell.row,cell.col});
-        }
-    }
-    for(auto &&[row,col]:m_state.mergedCells)
+    flushEngine();
+    auto promise = std::make_shared<QPromise<bool>>();
+    promise->start();
+    bool full = fullSave(tableName);
+    if(full && !fetchAll())
     {
-        auto cell = find(row,col);
-        if(cell)
-            emit mergeSig(cell->row,cell->col,cell->rowSpan,cell->colSpan);
+        promise->addResult(false);
+        promise->finish();
+        return promise->future();
     }
+    QList<int> dirty;
+    auto journal = takeJournal(tableName,full,dirty);
+    auto state = m_state;   //shared until the next edit detaches it
+    tableTrace::count(tableTrace::BytesSnapshotted,stateBytes(state));
+    //until the save commits, paging has to keep to what the journal said
+    m_saving.dirty.unite(journal.dirty);
+    m_saving.removed.unite(journal.removed);
+    m_savesRunning++;
+    auto fileName = m_dbFile;
+    m_ioPool.start([=]{
+        TRACE_SCOPE("savetoDbAsync");
+        //a backend of its own, its connection stays on this thread
+        auto db = tableBackend::forTable(fileName,tableName);
+        bool ok = db && writeSnapshot(*db,state,journal,dirty,promiseProgress(*promise));
+        db.reset();
+        QMetaObject::invokeMethod(this,[=]{
+            if(!ok)
+                m_journal.full = true;
+            if(--m_savesRunning == 0)
+                m_saving = SaveJournal();
+            promise->addResult(ok);
+            promise->finish();
+        },Qt::QueuedConnection);
+    });
+    return promise->future();
+}
 
-    emit dataChanged(index(0,0),index(rowCount()-1,columnCount()-1));
+QFuture<bool> mergeModel::loadFromDbAsync(const QString &tableName)
+{
+    auto promise = std::make_shared<QPromise<bool>>();
+    promise->start();
+    auto fileName = m_dbFile;
+    m_ioPool.start([=]{
+        TRACE_SCOPE("loadFromDbAsync");
+        auto next = std::make_shared<TableState>();
+        auto db = tableBackend::forTable(fileName,tableName);
+        bool ok = db && db->read(*next,promiseProgress(*promise));
+        db.reset();
+        //back on the GUI thread: the whole table is swapped in one go
+        QMetaObject::invokeMethod(this,[=]{
+            bool loaded = ok && !promise->isCanceled();
+            if(loaded)
+                installState(*next,tableName);
+            promise->addResult(loaded);
+            promise->finish();
+        },Qt::QueuedConnection);
+    });
+    return promise->future();
 }
 
-void mergeModel::clearTableMergeState()
+QFuture<bool> mergeModel::savetoJsonAsync(const QString &fileName)
 {
-    for(auto &&[row,col]:m_state.mergedCells)
+    flushEngine();
+    auto promise = std::make_shared<QPromise<bool>>();
+    promise->start();
+    if(!fetchAll())
     {
-        auto cell = find(row,col);
-        if(cell)
-            emit mergeSig(cell->row,cell->col);
+        promise->addResult(false);
+        promise->finish();
+        return promise->future();
     }
+    auto state = m_state;
+    tableTrace::count(tableTrace::BytesSnapshotted,stateBytes(state));
+    m_ioPool.start([=]{
+        TRACE_SCOPE("savetoJsonAsync");
+        bool ok = jsonBackend(fileName).write(state,promiseProgress(*promise));
+        promise->addResult(ok);
+        promise->finish();
+    });
+    return promise->future();
 }
 
-void mergeModel::initTable(const QString &tableName)
+QFuture<bool> mergeModel::loadFromJsonAsync(const QString &fileName)
 {
-    QSqlQuery query;
-
-    // Create the table if it doesn't exist
-    QString createTableQuery = QString(
-                                   "CREATE TABLE IF NOT EXISTS %1 ("
-                                   "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                                   "value TEXT, "
-                                   "row INTEGER, "
-                                   "col INTEGER,"
-                                   "rowSpan INTEGER,"
-                                   "colSpan INTEGER)").arg(tableName);
-
-    if (!query.exec(createTableQuery)) {
-        qDebug() << "Failed to create table:" << query.lastError();
-    } else {
-        qDebug() << "Table created or already exists.";
-    }
+    auto promise = std::make_shared<QPromise<bool>>();
+    promise->start();
+    m_ioPool.start([=]{
+        TRACE_SCOPE("loadFromJsonAsync");
+        auto next = std::make_shared<TableState>();
+        bool ok = jsonBackend(fileName).read(*next,promiseProgress(*promise));
+        QMetaObject::invokeMethod(this,[=]{
+            bool loaded = ok && !promise->isCanceled();
+            if(loaded)
+                installState(*next,QString());
+            promise->addResult(loaded);
+            promise->finish();
+        },Qt::QueuedConnection);
+    });
+    return promise->future();
+}
 
-    // Check if the table is already populated
-    QString countQueryStr = QString("SELECT COUNT(*) FROM %1").arg(tableName);
-    if (!query.exec(countQueryStr)) {
-        qDebug() << "Failed to check table data:" << query.lastError();
-        return;
-    }
+//the engine starts from the model's table and tells nobody but itself what
+//it changes; its index is built by the first job, off the GUI thread
+mergeModel::mergeModel(const TableState &state, int nextId)
+    : QAbstractTableModel(nullptr)
+    , m_state(state)
+    , m_nextId(nextId)
+    , m_detached(true)
+{
+    m_journal.full = false;
+    auto note = [this](EngineNote::Kind kind, int row, int col, int rowSpan, int colSpan){
+        m_notes.append({kind,row,col,rowSpan,colSpan});
+    };
+    connect(this,&QAbstractItemModel::rowsInserted,this,[note](const QModelIndex &, int first, int last){
+        note(EngineNote::InsertRows,first,0,last-first+1,1);
+    },Qt::DirectConnection);
+    connect(this,&QAbstractItemModel::rowsRemoved,this,[note](const QModelIndex &, int first, int last){
+        note(EngineNote::RemoveRows,first,0,last-first+1,1);
+    },Qt::DirectConnection);
+    connect(this,&QAbstractItemModel::columnsInserted,this,[note](const QModelIndex &, int first, int last){
+        note(EngineNote::InsertColumns,0,first,1,last-first+1);
+    },Qt::DirectConnection);
+    connect(this,&QAbstractItemModel::columnsRemoved,this,[note](const QModelIndex &, int first, int last){
+        note(EngineNote::RemoveColumns,0,first,1,last-first+1);
+    },Qt::DirectConnection);
+    connect(this,&mergeModel::mergeSig,this,[note](int row, int col, int rowSpan, int colSpan){
+        note(EngineNote::Span,row,col,rowSpan,colSpan);
+    },Qt::DirectConnection);
+    connect(this,&QAbstractItemModel::dataChanged,this,[note](const QModelIndex &topLeft, const QModelIndex &bottomRight){
+        note(EngineNote::Changed,topLeft.row(),topLeft.column(),
+             bottomRight.row()-topLeft.row()+1,bottomRight.column()-topLeft.column()+1);
+    },Qt::DirectConnection);
+}
 
-    query.next();
-    int count = query.value(0).toInt();
+//structural edits of a big table go to the engine, and once one is queued
+//every later edit follows it so they all apply in order. An edit group
+//decided at its start, a paged table and the engine itself edit in place
+bool mergeModel::offThread(bool structural) const
+{
+    if(m_editDepth > 0)
+        return m_groupPosted;
+    if(m_detached || m_paged)
+        return false;
+    return m_engineJobs > 0 || (structural && m_state.cells.size() >= ENGINECELLS);
+}
 
-    // If the table is already populated, skip the insertion
-    if (count > 0) {
-        qDebug() << "Table is already populated. Skipping initial data insertion.";
+//edit runs against the engine on m_ioPool, after whatever was queued there
+//before it, saves and loads included. Inside a posted group it waits for the
+//group's end. Undo and redo keep the redo stack, newEdit is false for them
+void mergeModel::post(const std::function<void(mergeModel&)> &edit, bool newEdit)
+{
+    if(m_groupPosted)
+    {
+        m_groupEdits.append(edit);
         return;
     }
-
-    m_db.transaction();
-
-    QString insertQueryStr = QString("INSERT INTO %1 (value, row, col, rowSpan, colSpan) VALUES (?, ?, ?, ?, ?)").arg(tableName);
-    query.prepare(insertQueryStr);
-
-    int gridSize = 6; // Define the size of the grid
-    for (int row = 0; row < gridSize; ++row) {
-        for (int col = 0; col < gridSize; ++col) {
-            query.bindValue(0, "Cell");  // Empty value for now
-            query.bindValue(1, row);
-            query.bindValue(2, col);
-            query.bindValue(3, 1);  // rowSpan
-            query.bindValue(4, 1);  // colSpan
-
-            if (!query.exec()) {
-                qDebug() << "Failed to insert cell:" << query.lastError();
-                m_db.rollback(); // Rollback the transaction on failure
-                return;
-            }
-        }
+    bool first = m_engineJobs++ == 0;
+    if(first)
+    {
+        m_engine.reset(new mergeModel(m_state,m_nextId));
+        tableTrace::count(tableTrace::BytesSnapshotted,stateBytes(m_state));
     }
-    //use a deep copy, iterator maybe invalid
-    m_db.commit();
-    emit dataChanged(index(0,0),index(3,3));
-    qDebug() << "Cells inserted into table successfully.";
-}
-
-//注意如果在操作返回值期间对容器进行修改，需要进行复制
-Cell *mergeModel::find(int row, int col)
-{
-    auto it =std::find_if(m_state.cells.begin(),m_state.cells.end(),[row,col](const Cell&cell)
+    auto engine = m_engine.get();   //kept until its last result is published
+    if(newEdit)
     {
-        return cell.row == row && cell.col == col;
+        m_redoStack.clear();
+        emit enableRedo(false);
+    }
+    m_ioPool.start([this,engine,edit,first,newEdit]{
+        TRACE_SCOPE("engineJob");
+        if(first)
+            engine->rebuildIndex();
+        edit(*engine);
+
+        EngineResult result;
+        result.state = engine->m_state;     //shared until the engine edits again
+        result.index = engine->m_index;
+        result.byId = engine->m_byId;
+        result.nextId = engine->m_nextId;
+        result.journal = engine->m_journal;
+        result.done = engine->m_undoStack.takeAll();
+        result.newEdit = newEdit;
+        result.notes.swap(engine->m_notes);
+        engine->m_journal = SaveJournal();
+        engine->m_journal.full = false;
+        {
+            QMutexLocker lock(&m_publishLock);
+            m_published.append(std::move(result));
+        }
+        QMetaObject::invokeMethod(this,&mergeModel::publishEngine,Qt::QueuedConnection);
     });
-
-    if(it != m_state.cells.end())
-        return &(*it);
-    else
-        return nullptr;
 }
 
-void mergeModel::setFirstRowHeader(bool b)
+void mergeModel::publishEngine()
 {
-    m_state.firstHeaderRow = b;
+    TRACE_SCOPE("publishEngine");
+    QList<EngineResult> results;
+    {
+        QMutexLocker lock(&m_publishLock);
+        results.swap(m_published);
+    }
+    for(auto &result : results)
+    {
+        publish(result);
+        if(--m_engineJobs == 0)
+            m_engine.reset();
+    }
 }
 
-void mergeModel::setFirstColHeader(bool b)
+//moves a rectangle along with the rows or columns a later note inserted
+//(delta > 0) or removed at first, false once nothing of it is left
+static bool moveRect(QRect &rect, bool rows, int first, int delta)
 {
-    m_state.firstHeaderCol = b;
+    int lo = rows ? rect.top() : rect.left();
+    int hi = rows ? rect.bottom() : rect.right();
+    if(delta > 0)
+    {
+        if(lo >= first)
+            lo += delta;
+        if(hi >= first)
+            hi += delta;
+    }else
+    {
+        int last = first-delta-1;
+        lo = lo < first ? lo : lo > last ? lo+delta : first;
+        hi = hi < first ? hi : hi > last ? hi+delta : first-1;
+        if(hi < lo)
+            return false;
+    }
+    if(rows)
+        rect = QRect(rect.left(),lo,rect.width(),hi-lo+1);
+    else
+        rect = QRect(lo,rect.top(),hi-lo+1,rect.height());
+    return true;
 }
 
-void mergeModel::increaseCol(int col, int rowBegin, int totalRow)
+//replay what the engine told itself, stepping the axes and the old index so
+//the views see the right counts and can still read the old cells meanwhile,
+//then swap the engine's table in as a whole
+void mergeModel::publish(EngineResult &result)
 {
-    //从当前列最后一个递增起
-    for(int curRow = totalRow -1 ; curRow>=rowBegin;)
+    //changed cells are told after the swap, where the later notes moved them
+    QList<QRect> changed;
+    auto moveChanged = [&changed](bool rows, int first, int delta){
+        for(auto it = changed.begin(); it != changed.end();)
+        {
+            if(moveRect(*it,rows,first,delta))
+                ++it;
+            else
+                it = changed.erase(it);
+        }
+    };
+    for(auto &&note : result.notes)
     {
-        auto cell = this->find(curRow,col);
-        if(!cell)
+        switch(note.kind)
         {
-            curRow--;
-            continue;
+        case EngineNote::InsertRows:
+            beginInsertRows(QModelIndex(),note.row,note.row+note.rowSpan-1);
+            m_state.rowMap.insert(note.row,note.rowSpan);
+            m_index.insertRows(note.row,note.rowSpan);
+            endInsertRows();
+            moveChanged(true,note.row,note.rowSpan);
+            break;
+        case EngineNote::RemoveRows:
+            beginRemoveRows(QModelIndex(),note.row,note.row+note.rowSpan-1);
+            m_state.rowMap.remove(note.row,note.rowSpan);
+            m_index.removeRows(note.row,note.rowSpan);
+            endRemoveRows();
+            moveChanged(true,note.row,-note.rowSpan);
+            break;
+        case EngineNote::InsertColumns:
+            beginInsertColumns(QModelIndex(),note.col,note.col+note.colSpan-1);
+            m_state.colMap.insert(note.col,note.colSpan);
+            m_index.insertColumns(note.col,note.colSpan);
+            endInsertColumns();
+            moveChanged(false,note.col,note.colSpan);
+            break;
+        case EngineNote::RemoveColumns:
+            beginRemoveColumns(QModelIndex(),note.col,note.col+note.colSpan-1);
+            m_state.colMap.remove(note.col,note.colSpan);
+            m_index.removeColumns(note.col,note.colSpan);
+            endRemoveColumns();
+            moveChanged(false,note.col,-note.colSpan);
+            break;
+        case EngineNote::Span:
+            emit mergeSig(note.row,note.col,note.rowSpan,note.colSpan);
+            break;
+        case EngineNote::Changed:
+            changed.append(QRect(note.col,note.row,note.colSpan,note.rowSpan));
+            break;
         }
-        cell->row++;
-        curRow--;
-
-        qDebug() << "increase Cell:";
-        print(*cell);
     }
-}
 
-void mergeModel::increaseRow(int row, int colBegin, int totalColumn)
-{
-    for(int curCol = totalColumn -1; curCol >= colBegin;)
+    auto firstHeaderRow = m_state.firstHeaderRow;
+    auto firstHeaderCol = m_state.firstHeaderCol;
+    m_state = std::move(result.state);
+    m_state.firstHeaderRow = firstHeaderRow;
+    m_state.firstHeaderCol = firstHeaderCol;
+    m_index = std::move(result.index);
+    m_byId = std::move(result.byId);
+    m_nextId = qMax(m_nextId,result.nextId);
+    checkExtents();
+
+    //a full save writes everything anyway; with nothing pending the job's journal is taken as is
+    if(!m_journal.full && m_journal.dirty.isEmpty() && m_journal.removed.isEmpty())
+    {
+        m_journal.dirty = std::move(result.journal.dirty);
+        m_journal.removed = std::move(result.journal.removed);
+    }else if(!m_journal.full)
     {
-        auto cell = this->find(row,curCol);
-        if(!cell)
+        for(auto id : result.journal.removed)
+            markRemoved(id);
+        for(auto id : result.journal.dirty)
+            markDirty(id);
+    }
+    m_journal.shifts.append(result.journal.shifts);
+    for(auto &&cmd : result.done)
+    {
+        if(result.newEdit)
         {
-            curCol--;
+            pushUndo(cmd);
             continue;
         }
-        cell->col++;
-        curCol--;
-        qDebug().nospace() << "increase Cell:";
-        print(*cell);
+        m_undoStack.push(cmd);
+        emit enableUndo(true);
     }
+
+    for(auto &&rect : changed)
+        emit dataChanged(index(rect.top(),rect.left()),index(rect.bottom(),rect.right()));
 }
 
-void mergeModel::print(Cell cell)
+//wait for the queued edits and swap them in, for whatever reads or replaces the table next
+void mergeModel::flushEngine()
 {
-    qDebug() << cell.row << cell.col << cell.rowSpan<<cell.colSpan <<cell.val;
+    if(m_engineJobs == 0)
+        return;
+    m_ioPool.waitForDone();
+    publishEngine();
 }
 
-void mergeModel::printTable()
+void mergeModel::waitForEdits()
 {
-    sortTable();
-    for (const Cell &cell : m_state.cells) {
-        qDebug().noquote() << "Cell at (" << cell.row << ", " << cell.col << "): "
-                                     << "Value = " << cell.val << ", "
-                                     << "RowSpan = " << cell.rowSpan << ", "
-                                     << "ColSpan = " << cell.colSpan;
-    }
-    qDebug().noquote()<< QString("Table Contents total %1:").arg(m_state.cells.size());
+    flushEngine();
 }
 
-void mergeModel::sortTable()
+//what is in memory now: a paged table counts its resident bands, the engine's copy is left out
+MemoryUsage mergeModel::memoryUsage() const
 {
-    std::sort(m_state.cells.begin(),m_state.cells.end(),[](const Cell &a, const Cell &b){
-        if(a.row != b.row)
-            return a.row < b.row;
-        else
-            return a.col < b.col;
-    });
+    MemoryUsage usage;
+    usage.cells = m_state.cells.cellBytes() + m_state.rowMap.bytes() + m_state.colMap.bytes()
+                  + m_byId.size()*qint64(2*sizeof(int)+sizeof(void*));
+    usage.strings = m_state.cells.valueBytes();
+    usage.mergedIndex = m_index.bytes() + m_state.mergedCells.size()*qint64(sizeof(QPair<int,int>));
+    usage.undo = m_undoStack.bytes();
+    if(m_editDepth > 0)
+        usage.undo += undoHistory::commandBytes(m_editGroup);
+    usage.redo = m_redoStack.bytes();
+    usage.spilled = m_undoStack.spilledBytes() + m_redoStack.spilledBytes();
+    return usage;
 }
 
-void mergeModel::appendAndIncreseRow(int row, int col, int totalCol, int rowSpan, int colSpan, const QString &val)
+void mergeModel::setUndoBudget(qint64 bytes)
 {
-    Cell cell;
-    cell.row = row;
-    cell.col = col;
-    cell.colSpan = colSpan;
-    cell.rowSpan = rowSpan;
-    cell.val = val;
+    m_undoStack.setBudget(bytes);
+    m_redoStack.setBudget(bytes);
+}
 
-    qDebug().nospace()<<"append new Cell:";
-    print(cell);
+//swap loaded cells in; tableName is where they came from, empty for a file.
+//file is the mapped file the values point into, if any
+void mergeModel::installState(TableState &next, const QString &tableName, std::shared_ptr<tableFile> file)
+{
+    TRACE_SCOPE("installState");
+    flushEngine();
+    m_paged = false;
+    m_bands.clear();
+    m_ingestPending.clear();
+    m_wantedBands.clear();
+    adoptAxes(next);
+    applyState(std::move(next));
+    compactAxes();
+    clearHistory();
+    m_journal = SaveJournal();
+    m_journal.full = tableName.isEmpty();
+    m_journal.table = tableName;
+    //nothing but a running save can still hold values of the file replaced here
+    m_ioPool.waitForDone();
+    m_file = file;
+}
 
-    increaseRow(row,col,totalCol);
-    m_state.cells.append(cell);
+//whether a save to tableName has to write every cell
+bool mergeModel::fullSave(const QString &tableName) const
+{
+    return m_journal.full || m_journal.table != tableName || m_saveFailed.loadAcquire();
 }
 
-void mergeModel::appendAndIncreaseCol(int row, int col, int totalRow, int rowSpan, int colSpan, const QString &val)
+//hand the pending changes to a save, edits from now on are journaled afresh
+SaveJournal mergeModel::takeJournal(const QString &tableName, bool full, QList<int> &dirty)
 {
-    Cell cell;
-    cell.row = row;
-    cell.col = col;
-    cell.colSpan = colSpan;
-    cell.rowSpan = rowSpan;
-    cell.val = val;
+    auto journal = m_journal;
+    journal.full = full;
+    if(!journal.full)
+    {
+        for(auto id : journal.dirty)
+            dirty.append(m_byId.value(id));
+    }
+    m_journal = SaveJournal();
+    m_journal.full = false;
+    m_journal.table = tableName;
+    return journal;
+}
 
-    qDebug().nospace()<<"append new Cell:";
-    print(cell);
+bool mergeModel::loadFromDbPaged(const QString &tableName, int bandSize)
+{
+    TRACE_SCOPE("loadFromDbPaged");
+    m_ioPool.waitForDone();
+    publishEngine();
+    int rows = 0;
+    int cols = 0;
+    int lastId = -1;
+    bool sparse = false;
+    auto db = backend(tableName);
+    if(!db || !db->extents(rows,cols,lastId,sparse))
+        return false;
 
-    increaseCol(col,row,totalRow);
-    m_state.cells.append(cell);
+    clearTableMergeState();
+    beginResetModel();
+    TableState next;
+    next.firstHeaderRow = m_state.firstHeaderRow;
+    next.firstHeaderCol = m_state.firstHeaderCol;
+    next.sparse = sparse;
+    next.colMap.reset(cols);
+    m_state = std::move(next);
+    m_index.reset(0,cols);
+    m_byId.clear();
+    m_nextId = lastId+1;
+    m_paged = rows > 0;
+    m_pageBackend = db;
+    m_pageRows = rows;
+    m_bandSize = qMax(bandSize,1);
+    m_bands.clear();
+    m_ingestPending.clear();
+    m_wantedBands.clear();
+    m_pageFocus = 0;
+    endResetModel();
+
+    clearHistory();
+    m_journal = SaveJournal();
+    m_journal.full = false;
+    m_journal.table = tableName;
+    m_file.reset();
+    fetchMore(QModelIndex());
+    qCDebug(lcIO) << "Paging" << rows << "rows from" << tableName;
+    return true;
 }
 
-Cell *mergeModel::findSpanOnCol(int row, int col)
+void mergeModel::setPageBudget(qint64 bytes)
 {
-    for(int curRow = 0;curRow < row;curRow++)
-    {
-        auto cell = find(curRow,col);
-        if(cell && cell->rowSpan+cell->row > row)
-            return cell;
-    }
+    m_pageBudget = bytes;
+    if(m_paged)
+        evictFarBands();
+}
 
-    return nullptr;
+bool mergeModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_paged && m_state.rowMap.size() < m_pageRows;
 }
 
-Cell *mergeModel::findSpanOnRow(int row, int col)
+void mergeModel::fetchMore(const QModelIndex &parent)
 {
-    for(int curCol=0;curCol < col;curCol++)
-    {
-        auto cell = find(row,curCol);
-        if(cell && cell->colSpan+cell->col > col)
-            return cell;
-    }
-    return nullptr;
+    if(!canFetchMore(parent))
+        return;
+    appendBand();
+    evictFarBands();
 }
 
-void mergeModel::saveCurrentState()
+//show the next band's rows and read its cells
+void mergeModel::appendBand()
 {
-    if(m_undoStack.size() > MAXSTACKSIZE){
-        m_undoStack.pop_front();
-    }
-    m_undoStack.push_back(m_state);
+    auto first = m_state.rowMap.size();
+    auto last = m_pageBackend->bandEnd(first,qMin(first+m_bandSize,m_pageRows)-1);
+    beginInsertRows(QModelIndex(),first,last);
+    m_state.rowMap.insert(first,last-first+1);
+    m_index.insertRows(first,last-first+1);
+    m_bands.insert(first,{last});
+    auto spans = loadBand(first);
+    endInsertRows();
+    for(auto &&rect : spans)
+        emit mergeSig(rect.y(),rect.x(),rect.height(),rect.width());
+    applyPending(first);
+}
 
-    m_redoStack.clear();
-    emit enableUndo(true);
-    emit enableRedo(false);
+//rough footprint of a resident cell: its columns, its text even if another
+//cell shares it, and its id lookup
+static qint64 cellBytes(const Cell &cell)
+{
+    return 6*sizeof(int) + cell.val.size()*sizeof(QChar) + 2*sizeof(int);
 }
 
-void mergeModel::undo()
+//read a band's cells in, returns the spans of the merged ones for the view
+QList<QRect> mergeModel::loadBand(int first)
 {
-    if(m_undoStack.isEmpty())
-    {
-        qDebug() << "Noting to undo";
-        emit enableUndo(false);
-        return;
-    }
-    beginResetModel();
-    clearTableMergeState();
-    if(m_redoStack.size() >= MAXSTACKSIZE)
+    TRACE_SCOPE("loadBand");
+    auto &band = m_bands[first];
+    QList<Cell> cells;
+    if(!m_pageBackend->readBand(first,band.last,cells))
+        return {};
+
+    QList<QRect> spans;
+    band.resident = true;
+    band.bytes = qint64(band.last-first+1)*m_state.colMap.size()*sizeof(int);
+    for(auto &&cell : cells)
     {
-        m_redoStack.pop_front();
+        //resident already, or deleted but not saved yet: a sparse cell set
+        //back to the default leaves the table, not the database
+        if(m_byId.contains(cell.id) || m_journal.removed.contains(cell.id) ||
+           m_saving.removed.contains(cell.id))
+            continue;
+        band.bytes += cellBytes(cell);
+        if(cell.rowSpan > 1 || cell.colSpan > 1)
+            spans.append(QRect(cell.col,cell.row,cell.colSpan,cell.rowSpan));
+        addLoadedCell(cell);
     }
-    m_redoStack.push_back(m_state);
-    m_state = m_undoStack.takeLast();
-    restoreTableMergeState();
-    // emit dataChanged(index(0,0),index(rowCount()-1,columnCount()-1)) ;
-    endResetModel();
-    printTable();
+    for(auto &&rect : spans)
+        m_state.mergedCells.append({m_state.rowMap.toPhysical(rect.y()),m_state.colMap.toPhysical(rect.x())});
+    return spans;
+}
 
-    emit enableRedo(true);
+//read an evicted band back in place
+bool mergeModel::reloadBand(int first)
+{
+    for(auto &&rect : loadBand(first))
+        emit mergeSig(rect.y(),rect.x(),rect.height(),rect.width());
+    auto band = m_bands.value(first);
+    if(!band.resident)
+        return false;
+    emit dataChanged(index(first,0),index(band.last,columnCount()-1));
+    applyPending(first);
+    return true;
 }
 
-void mergeModel::redo()
+//the values ingested while a band was not in memory, once it is. They make
+//the band dirty, so it stays until saved
+void mergeModel::applyPending(int first)
 {
-    if(m_redoStack.isEmpty())
-    {
-        qDebug() << "nothing to redo";
-        emit enableRedo(false);
+    auto last = m_bands.value(first).last;
+    auto it = m_ingestPending.lowerBound(first);
+    if(it == m_ingestPending.end() || it.key() > last)
         return;
-    }
-
-    beginResetModel();
-    clearTableMergeState();
-    if(m_undoStack.size() >= MAXSTACKSIZE)
+    holdChanges();
+    while(it != m_ingestPending.end() && it.key() <= last)
     {
-        m_undoStack.pop_front();
+        for(auto col = it->cbegin(); col != it->cend(); ++col)
+            applyIngest(it.key(),col.key(),col.value());
+        it = m_ingestPending.erase(it);
     }
-    m_undoStack.push_back(m_state);
-
-    m_state = m_redoStack.takeLast();
-    restoreTableMergeState();
-    endResetModel();
-
-    emit enableUndo(true);
+    releaseChanges();
+}
 
-    printTable();
-    // emit dataChanged(index(0,0),index(rowCount()-1, columnCount()-1));
+//positions in m_state.cells of the cells anchored in a band, highest first
+QList<int> mergeModel::bandCells(int first) const
+{
+    //row ids are the rows while paging
+    QList<int> cells;
+    const auto &store = m_state.cells;
+    selectAnchored(store.rows(),store.cols(),store.size(),first,0,m_bands.value(first).last,INT_MAX-1,cells);
+    std::reverse(cells.begin(),cells.end());
+    return cells;
 }
 
-void mergeModel::removeRow_(int row)
+//drop a band's cells without journaling, the database still has them
+void mergeModel::evictBand(int first, QList<int> cells)
 {
-    if(row < 0 || row >= rowCount())
-        return;
-    saveCurrentState();
-    beginRemoveRows(QModelIndex(),row,row);
-    for(int i = 0; i < m_state.cells.size(); ++i)
+    auto &band = m_bands[first];
+    for(auto i : cells)
     {
-        Cell &cell = m_state.cells[i];
-
-        if(cell.row <= row && cell.row+cell.rowSpan > row)
+        const auto &cell = m_state.cells.at(i);
+        if(cell.rowSpan > 1 || cell.colSpan > 1)
         {
-            if(cell.rowSpan > 1)
-                cell.rowSpan--;
-            else{
-                m_state.cells.removeAt(i);
-                i--;
-            }
-        }else if(cell.row > row){
-            cell.row--;
+            emit mergeSig(cellRow(cell),cellCol(cell));
+            m_state.mergedCells.removeAll(qMakePair(cell.row,cell.col));
         }
-
+        dropCellAt(i);
     }
-    endRemoveRows();
-    printTable();
+    m_index.releaseRows(first,band.last-first+1);
+    band.resident = false;
+    band.bytes = 0;
 }
 
-void mergeModel::removeColumn_(int col)
+//over budget, drop the bands farthest from the rows painted last. The band in
+//view and its neighbours stay, as do bands holding edits not saved yet
+void mergeModel::evictFarBands()
 {
-    if(col < 0 || col >= columnCount())
+    qint64 total = 0;
+    QList<QPair<int,int>> order;    //distance, first row
+    for(auto it = m_bands.cbegin(); it != m_bands.cend(); ++it)
+    {
+        if(!it->resident)
+            continue;
+        total += it->bytes;
+        auto distance = it.key() > m_pageFocus ? it.key()-m_pageFocus : qMax(m_pageFocus-it->last,0);
+        order.append({distance,it.key()});
+    }
+    std::sort(order.begin(),order.end(),std::greater<QPair<int,int>>());
+
+    for(auto &&[distance,first] : order)
+    {
+        if(total <= m_pageBudget || distance <= m_bandSize)
+            break;
+        auto cells = bandCells(first);
+        bool pinned = std::any_of(cells.cbegin(),cells.cend(),[this](int i){
+            auto id = m_state.cells.at(i).id;
+            return m_journal.dirty.contains(id) || m_saving.dirty.contains(id);
+        });
+        if(pinned)
+            continue;
+        total -= m_bands.value(first).bytes;
+        evictBand(first,cells);
+    }
+}
+
+//data() found no cell: queue a read of the band if it was evicted
+void mergeModel::requestBand(int row) const
+{
+    auto it = m_bands.upperBound(row);
+    if(it == m_bands.cbegin())
+        return;
+    --it;
+    if(it->resident || m_wantedBands.contains(it.key()))
+        return;
+    if(m_wantedBands.isEmpty())
+        QMetaObject::invokeMethod(const_cast<mergeModel*>(this),&mergeModel::loadWantedBands,Qt::QueuedConnection);
+    m_wantedBands.insert(it.key());
+}
+
+void mergeModel::loadWantedBands()
+{
+    auto wanted = m_wantedBands;
+    m_wantedBands.clear();
+    for(auto first : wanted)
+    {
+        if(m_paged && m_bands.contains(first) && !m_bands.value(first).resident)
+            reloadBand(first);
+    }
+    evictFarBands();
+}
+
+//edits that move cells need the whole table, paging ends here
+bool mergeModel::fetchAll()
+{
+    TRACE_SCOPE("fetchAll");
+    if(!m_paged)
+        return true;
+    while(m_state.rowMap.size() < m_pageRows)
+        appendBand();
+    for(auto first : m_bands.keys())
+    {
+        if(!m_bands.value(first).resident && !reloadBand(first))
+        {
+            qCWarning(lcIO) << "Failed to read the whole table";
+            return false;
+        }
+    }
+    m_paged = false;
+    m_bands.clear();
+    m_ingestPending.clear();
+    m_wantedBands.clear();
+    checkExtents();
+    return true;
+}
+
+//a value edit only needs its own band, a group what its edits need, anything else the whole table
+bool mergeModel::prepareCommand(const TableCommand &cmd)
+{
+    if(!m_paged)
+        return true;
+    if(cmd.type == TableCommand::Group)
+    {
+        for(auto &&child : cmd.children)
+            if(!prepareCommand(child))
+                return false;
+        return true;
+    }
+    if(cmd.type != TableCommand::SetValue)
+        return fetchAll();
+    return loadRow(cmd.row);
+}
+
+//read the row's band back in if it was evicted
+bool mergeModel::loadRow(int row)
+{
+    if(isResident(row))
+        return true;
+    auto it = m_bands.upperBound(row);
+    return it != m_bands.begin() && reloadBand((--it).key());
+}
+
+//whether the row's cells are in memory, false for a paged row whose band is evicted
+bool mergeModel::isResident(int row) const
+{
+    if(!m_paged)
+        return true;
+    auto it = m_bands.upperBound(row);
+    if(it == m_bands.begin())
+        return false;
+    --it;
+    return it->resident;
+}
+
+//a failed or canceled save leaves the database behind every later journal,
+//so until a full save goes through nothing incremental may be written.
+//Runs on whichever thread does the save
+bool mergeModel::writeSnapshot(tableBackend &backend, const TableState &state,
+                               const SaveJournal &journal, const QList<int> &dirty,
+                               const std::function<bool(qint64,qint64)> &progress)
+{
+    if(!journal.full && m_saveFailed.loadAcquire())
+        return false;
+    bool ok = backend.writeChanges(state,journal,dirty,progress);
+    if(!ok)
+        m_saveFailed.storeRelease(1);
+    else if(journal.full)
+        m_saveFailed.storeRelease(0);
+    return ok;
+}
+
+void mergeModel::restoreTableMergeState(bool init)
+{
+    if(init)
+    {
+        m_state.mergedCells.clear();
+        const auto &cells = m_state.cells;
+        QList<int> merged;
+        selectMerged(cells.rowSpans(),cells.colSpans(),cells.size(),merged);
+        for(auto i : merged)
+            m_state.mergedCells.append({cells.rows()[i],cells.cols()[i]});
+    }
+    for(auto &&[rowId,colId]:m_state.mergedCells)
+    {
+        auto row = m_state.rowMap.toLogical(rowId);
+        auto col = m_state.colMap.toLogical(colId);
+        auto cell = find(row,col);
+        if(cell)
+            emit mergeSig(row,col,cell->rowSpan,cell->colSpan);
+    }
+}
+
+void mergeModel::clearTableMergeState()
+{
+    for(auto &&[rowId,colId]:m_state.mergedCells)
+    {
+        auto row = m_state.rowMap.toLogical(rowId);
+        auto col = m_state.colMap.toLogical(colId);
+        if(find(row,col))
+            emit mergeSig(row,col);
+    }
+}
+
+void mergeModel::initTable(const QString &tableName)
+{
+    auto db = backend(tableName);
+
+    // Create the table if it doesn't exist
+    if (!db || !db->create()) {
+        qCWarning(lcIO) << "Failed to create table" << tableName;
+        return;
+    }
+    qCDebug(lcIO) << "Table created or already exists.";
+
+    // If the table is already populated, skip the insertion
+    if (db->count() > 0) {
+        qCDebug(lcIO) << "Table is already populated. Skipping initial data insertion.";
+        return;
+    }
+
+    //written as edited cells, one batch in one transaction
+    int gridSize = 6; // Define the size of the grid
+    TableState seed;
+    seed.rowMap.reset(gridSize);
+    seed.colMap.reset(gridSize);
+    SaveJournal journal;
+    journal.full = false;
+    QList<int> dirty;
+    for (int row = 0; row < gridSize; ++row) {
+        for (int col = 0; col < gridSize; ++col) {
+            Cell cell;
+            cell.val = CELLDEFAULT;
+            cell.row = row;
+            cell.col = col;
+            cell.id = seed.cells.size()+1;
+            dirty.append(seed.cells.size());
+            seed.cells.append(cell);
+        }
+    }
+    if (!db->writeChanges(seed,journal,dirty)) {
+        qCWarning(lcIO) << "Failed to insert cells into" << tableName;
+        return;
+    }
+    emit dataChanged(index(0,0),index(3,3));
+    qCDebug(lcIO) << "Cells inserted into table successfully.";
+}
+
+//注意如果在操作返回值期间对容器进行修改，需要进行复制
+std::optional<cellRef> mergeModel::find(int row, int col)
+{
+    tableTrace::count(tableTrace::FindProbes);
+    auto i = m_index.owner(row,col);
+    if(i < 0)
+        return std::nullopt;
+
+    if(m_state.cells.rows()[i] == m_state.rowMap.toPhysical(row) && m_state.cells.cols()[i] == m_state.colMap.toPhysical(col))
+        return m_state.cells[i];
+    return std::nullopt;
+}
+
+std::optional<Cell> mergeModel::cellAt(int row, int col) const
+{
+    tableTrace::count(tableTrace::FindProbes);
+    auto i = m_index.owner(row,col);
+    if(i < 0)
+        return std::nullopt;
+    return m_state.cells.at(i);
+}
+
+cellHandle mergeModel::handleAt(int row, int col) const
+{
+    auto i = m_index.owner(row,col);
+    if(i < 0)
+        return cellHandle();
+    return m_state.cells.handle(i);
+}
+
+std::optional<cellRef> mergeModel::find(cellHandle handle)
+{
+    auto i = m_state.cells.indexOf(handle);
+    if(i < 0)
+        return std::nullopt;
+    return m_state.cells[i];
+}
+
+//where the cell sits now, empty once it is gone
+QRect mergeModel::cellRect(cellHandle handle) const
+{
+    auto i = m_state.cells.indexOf(handle);
+    if(i < 0)
+        return QRect();
+    return rectAt(i);
+}
+
+QRect mergeModel::rectAt(int i) const
+{
+    const auto &cells = m_state.cells;
+    return QRect(m_state.colMap.toLogical(cells.cols()[i]),m_state.rowMap.toLogical(cells.rows()[i]),
+                 cells.colSpans()[i],cells.rowSpans()[i]);
+}
+
+//grow rect until no cell crosses its border. A cell reaching out of it
+//covers part of the border, so only the border is looked at
+QRect mergeModel::coveringRect(QRect rect) const
+{
+    for(;;)
+    {
+        auto next = rect;
+        auto cover = [this,&next](int row, int col){
+            auto i = m_index.owner(row,col);
+            if(i >= 0)
+                next |= rectAt(i);
+        };
+        for(int col = rect.left(); col <= rect.right(); col++)
+        {
+            cover(rect.top(),col);
+            cover(rect.bottom(),col);
+        }
+        for(int row = rect.top()+1; row < rect.bottom(); row++)
+        {
+            cover(row,rect.left());
+            cover(row,rect.right());
+        }
+        if(next == rect)
+            return rect;
+        rect = next;
+    }
+}
+
+int mergeModel::cellRow(const Cell &cell) const
+{
+    return m_state.rowMap.toLogical(cell.row);
+}
+
+int mergeModel::cellCol(const Cell &cell) const
+{
+    return m_state.colMap.toLogical(cell.col);
+}
+
+void mergeModel::setFirstRowHeader(bool b)
+{
+    m_state.firstHeaderRow = b;
+}
+
+void mergeModel::setFirstColHeader(bool b)
+{
+    m_state.firstHeaderCol = b;
+}
+
+void mergeModel::print(Cell cell)
+{
+    qCDebug(lcDump) << cellRow(cell) << cellCol(cell) << cell.rowSpan<<cell.colSpan <<cell.val;
+}
+
+//sorting and printing every cell takes longer than most edits, so only
+//when mergetable.dump is enabled. The category check is a runtime one,
+//builds without debug output drop the body altogether
+void mergeModel::printTable()
+{
+#ifndef QT_NO_DEBUG_OUTPUT
+    if(m_detached || !lcDump().isDebugEnabled())
+        return;
+    for (const Cell &cell : sortTable()) {
+        qCDebug(lcDump).noquote() << "Cell at (" << cellRow(cell) << ", " << cellCol(cell) << "): "
+                                     << "Value = " << cell.val << ", "
+                                     << "RowSpan = " << cell.rowSpan << ", "
+                                     << "ColSpan = " << cell.colSpan;
+    }
+    qCDebug(lcDump).noquote()<< QString("Table Contents total %1:").arg(m_state.cells.size());
+#endif
+}
+
+QList<Cell> mergeModel::sortTable() const
+{
+    //sort a copy, m_index refers to cells by position
+    QList<Cell> cells;
+    cells.reserve(m_state.cells.size());
+    for(auto &&cell : m_state.cells)
+        cells.append(cell);
+    std::sort(cells.begin(),cells.end(),[this](const Cell &a, const Cell &b){
+        if(a.row != b.row)
+            return cellRow(a) < cellRow(b);
+        else
+            return cellCol(a) < cellCol(b);
+    });
+    return cells;
+}
+
+void mergeModel::appendCell(int row, int col, int rowSpan, int colSpan, const QString &val, int id)
+{
+    Cell cell;
+    cell.id = id < 0 ? m_nextId++ : id;
+    m_nextId = qMax(m_nextId,cell.id+1);
+    cell.row = m_state.rowMap.toPhysical(row);
+    cell.col = m_state.colMap.toPhysical(col);
+    cell.colSpan = colSpan;
+    cell.rowSpan = rowSpan;
+    cell.val = val;
+
+    qCDebug(lcDump).nospace()<<"append new Cell:";
+    print(cell);
+
+    m_state.cells.append(cell);
+    m_index.fill(row,col,rowSpan,colSpan,m_state.cells.size()-1);
+    m_byId.insert(cell.id,m_state.cells.size()-1);
+    markDirty(cell.id);
+}
+
+void mergeModel::removeCellAt(int i)
+{
+    markRemoved(m_state.cells.at(i).id);
+    dropCellAt(i);
+}
+
+//swap with the last cell and pop, the caller clears the removed cell's own area
+void mergeModel::dropCellAt(int i)
+{
+    auto last = m_state.cells.size()-1;
+    m_byId.remove(m_state.cells.at(i).id);
+    m_state.cells.removeAt(i);
+    if(i != last)
+    {
+        const auto &moved = m_state.cells.at(i);
+        m_index.fill(cellRow(moved),cellCol(moved),moved.rowSpan,moved.colSpan,i);
+        m_byId.insert(moved.id,i);
+    }
+}
+
+//a cell read back by paging, with logical positions. Already stored, so not journaled
+void mergeModel::addLoadedCell(Cell cell)
+{
+    auto row = cell.row;
+    auto col = cell.col;
+    cell.row = m_state.rowMap.toPhysical(row);
+    cell.col = m_state.colMap.toPhysical(col);
+    m_nextId = qMax(m_nextId,cell.id+1);
+    m_state.cells.append(cell);
+    m_index.fill(row,col,cell.rowSpan,cell.colSpan,m_state.cells.size()-1);
+    m_byId.insert(cell.id,m_state.cells.size()-1);
+}
+
+void mergeModel::markDirty(int id)
+{
+    tableTrace::count(tableTrace::CellsTouched);
+    m_journal.removed.remove(id);
+    m_journal.dirty.insert(id);
+}
+
+void mergeModel::markRemoved(int id)
+{
+    tableTrace::count(tableTrace::CellsTouched);
+    m_journal.dirty.remove(id);
+    m_journal.removed.insert(id);
+}
+
+//cells past the cut that nothing else touched only need their position moved
+void mergeModel::recordShift(bool rows, int from, int delta)
+{
+    m_journal.shifts.append({rows,from,delta});
+}
+
+void mergeModel::rebuildIndex()
+{
+    TRACE_SCOPE("rebuildIndex");
+    m_index.clear();
+    m_byId.clear();
+    const auto &cells = m_state.cells;
+    m_byId.reserve(cells.size());
+    for(int i = 0; i < cells.size(); ++i)
+    {
+        m_index.fill(m_state.rowMap.toLogical(cells.rows()[i]),m_state.colMap.toLogical(cells.cols()[i]),
+                     cells.rowSpans()[i],cells.colSpans()[i],i);
+        m_byId.insert(cells.ids()[i],i);
+    }
+}
+
+//freshly loaded cells carry positions; give them the ids the current table
+//uses at those positions, so a reload only announces what really changed
+void mergeModel::adoptAxes(TableState &next) const
+{
+    //a sparse table brings its extents, they may reach past its cells
+    const auto &cells = next.cells;
+    int rows = qMax(maxEnd(cells.rows(),cells.rowSpans(),cells.size()),next.rowMap.size());
+    int cols = qMax(maxEnd(cells.cols(),cells.colSpans(),cells.size()),next.colMap.size());
+    next.rowMap = m_state.rowMap;
+    next.colMap = m_state.colMap;
+    if(rows > next.rowMap.size())
+        next.rowMap.insert(next.rowMap.size(),rows-next.rowMap.size());
+    else if(rows < next.rowMap.size())
+        next.rowMap.remove(rows,next.rowMap.size()-rows);
+    if(cols > next.colMap.size())
+        next.colMap.insert(next.colMap.size(),cols-next.colMap.size());
+    else if(cols < next.colMap.size())
+        next.colMap.remove(cols,next.colMap.size()-cols);
+
+    for(auto &&cell : next.cells)
+    {
+        cell.row = next.rowMap.toPhysical(cell.row);
+        cell.col = next.colMap.toPhysical(cell.col);
+    }
+    for(auto &&[row,col] : next.mergedCells)
+    {
+        row = next.rowMap.toPhysical(row);
+        col = next.colMap.toPhysical(col);
+    }
+    next.firstHeaderRow = m_state.firstHeaderRow;
+    next.firstHeaderCol = m_state.firstHeaderCol;
+}
+
+//the old table's ids were only needed to tell the view what moved,
+//a loaded one starts its axes over from 0
+void mergeModel::compactAxes()
+{
+    auto rows = m_state.rowMap.compact();
+    auto cols = m_state.colMap.compact();
+    for(auto &&cell : m_state.cells)
+    {
+        cell.row = rows.at(cell.row);
+        cell.col = cols.at(cell.col);
+    }
+    for(auto &&[row,col] : m_state.mergedCells)
+    {
+        row = rows.at(row);
+        col = cols.at(col);
+    }
+}
+
+//swap in another state of the table, telling the view only what differs
+void mergeModel::applyState(TableState &&next)
+{
+    //a binary file brings its merged anchors along
+    const auto &cells = next.cells;
+    if(next.mergedCells.isEmpty())
+    {
+        QList<int> merged;
+        selectMerged(cells.rowSpans(),cells.colSpans(),cells.size(),merged);
+        for(auto i : merged)
+            next.mergedCells.append({cells.rows()[i],cells.cols()[i]});
+    }
+    m_nextId = 0;
+    for(int i = 0; i < cells.size(); i++)
+        m_nextId = qMax(m_nextId,cells.ids()[i]+1);
+    //cells from a file have no database id yet
+    for(auto &&cell : next.cells)
+    {
+        if(cell.id < 0)
+            cell.id = m_nextId++;
+    }
+
+    auto diff = diffStates(m_state,next);
+    if(diff.reset)
+    {
+        clearTableMergeState();
+        beginResetModel();
+        m_state = std::move(next);
+        rebuildIndex();
+        endResetModel();
+        checkExtents();
+        restoreTableMergeState();
+        return;
+    }
+
+    for(auto &&pos : diff.clearedSpans)
+        emit mergeSig(pos.y(),pos.x());
+
+    //only the extents matter to the view between the steps,
+    //the cells are swapped once the rows and columns are in place
+    for(auto &&[first,count] : diff.removedRows)
+    {
+        beginRemoveRows(QModelIndex(),first,first+count-1);
+        m_state.rowMap.remove(first,count);
+        m_index.removeRows(first,count);
+        endRemoveRows();
+    }
+    for(auto &&[first,count] : diff.removedCols)
+    {
+        beginRemoveColumns(QModelIndex(),first,first+count-1);
+        m_state.colMap.remove(first,count);
+        m_index.removeColumns(first,count);
+        endRemoveColumns();
+    }
+    for(auto &&[first,count] : diff.insertedRows)
+    {
+        beginInsertRows(QModelIndex(),first,first+count-1);
+        m_state.rowMap.insert(first,count);
+        m_index.insertRows(first,count);
+        endInsertRows();
+    }
+    for(auto &&[first,count] : diff.insertedCols)
+    {
+        beginInsertColumns(QModelIndex(),first,first+count-1);
+        m_state.colMap.insert(first,count);
+        m_index.insertColumns(first,count);
+        endInsertColumns();
+    }
+
+    m_state = std::move(next);
+    rebuildIndex();
+    checkExtents();
+
+    for(auto &&rect : diff.newSpans)
+        emit mergeSig(rect.y(),rect.x(),rect.height(),rect.width());
+    for(auto &&rect : diff.changed)
+        emit dataChanged(index(rect.top(),rect.left()),index(rect.bottom(),rect.right()));
+}
+
+//debug builds compare the cached extents with a full scan
+void mergeModel::checkExtents() const
+{
+#ifndef QT_NO_DEBUG
+    //a paged table only holds the bands read so far
+    if(m_paged)
+        return;
+    int rows = 0;
+    int cols = 0;
+    for(auto &&cell : m_state.cells)
+    {
+        rows = qMax(rows,cellRow(cell)+cell.rowSpan);
+        cols = qMax(cols,cellCol(cell)+cell.colSpan);
+    }
+    //a sparse table may end in rows and columns without cells, a dense one
+    //that lost all its rows or columns keeps the other axis
+    bool empty = m_state.cells.isEmpty() && (m_state.rowMap.size() == 0 || m_state.colMap.size() == 0);
+    Q_ASSERT_X(m_state.sparse ? rows <= m_state.rowMap.size() && cols <= m_state.colMap.size() :
+                                empty || (rows == m_state.rowMap.size() && cols == m_state.colMap.size()),
+               "mergeModel::checkExtents","cached table extents out of sync");
+#endif
+}
+
+//the cell anchored on col above row that reaches down to row
+std::optional<cellRef> mergeModel::findSpanOnCol(int row, int col)
+{
+    auto i = m_index.owner(row,col);
+    if(i < 0)
+        return std::nullopt;
+    auto cell = m_state.cells[i];
+    if(cell.col == m_state.colMap.toPhysical(col) && m_state.rowMap.toLogical(cell.row) < row)
+        return cell;
+    return std::nullopt;
+}
+
+//the cell anchored on row left of col that reaches right to col
+std::optional<cellRef> mergeModel::findSpanOnRow(int row, int col)
+{
+    auto i = m_index.owner(row,col);
+    if(i < 0)
+        return std::nullopt;
+    auto cell = m_state.cells[i];
+    if(cell.row == m_state.rowMap.toPhysical(row) && m_state.colMap.toLogical(cell.col) < col)
+        return cell;
+    return std::nullopt;
+}
+
+
+void mergeModel::runCommand(TableCommand &cmd)
+{
+    if(!prepareCommand(cmd))
+        return;
+    applyCommand(cmd);
+
+    if(m_editDepth > 0)
+        m_editGroup.children.append(cmd);
+    else
+        pushUndo(cmd);
+}
+
+void mergeModel::pushUndo(const TableCommand &cmd)
+{
+    m_undoStack.push(cmd);
+
+    m_redoStack.clear();
+    emit enableUndo(true);
+    emit enableRedo(false);
+}
+
+void mergeModel::beginEditGroup()
+{
+    //whatever the group holds, a table this big gets it off the GUI thread
+    if(m_editDepth == 0 && offThread(true))
+    {
+        m_groupPosted = true;
+        m_editDepth++;
+        return;
+    }
+    openEditGroup();
+}
+
+//a group applied where its edits run, for edits that already decided that
+void mergeModel::openEditGroup()
+{
+    flushEngine();
+    if(m_editDepth++ > 0)
+        return;
+    m_editGroup = TableCommand();
+    m_editGroup.type = TableCommand::Group;
+    holdChanges();
+}
+
+void mergeModel::endEditGroup()
+{
+    if(m_editDepth == 0)
+    {
+        qCWarning(lcModel) << "endEditGroup without beginEditGroup";
+        return;
+    }
+    if(--m_editDepth > 0)
+        return;
+    if(m_groupPosted)
+    {
+        //one job, one publish and one undo step for the whole group
+        m_groupPosted = false;
+        auto edits = std::move(m_groupEdits);
+        m_groupEdits.clear();
+        if(!edits.isEmpty())
+        {
+            post([edits](mergeModel &engine){
+                engine.beginEditGroup();
+                for(auto &&edit : edits)
+                    edit(engine);
+                engine.endEditGroup();
+            });
+        }
+        return;
+    }
+    if(!m_editGroup.children.isEmpty())
+        pushUndo(m_editGroup);
+    m_editGroup = TableCommand();
+    releaseChanges();
+}
+
+void mergeModel::setValues(int top, int left, const QList<QStringList> &block)
+{
+    TRACE_SCOPE("setValues");
+    if(offThread(false))
+    {
+        post([=](mergeModel &engine){ engine.setValues(top,left,block); });
+        return;
+    }
+    openEditGroup();
+    for(int r = 0; r < block.size() && top+r < rowCount(); r++)
+    {
+        const auto &line = block.at(r);
+        for(int c = 0; c < line.size() && left+c < columnCount(); c++)
+            fillValue(top+r,left+c,line.at(c));
+    }
+    endEditGroup();
+}
+
+void mergeModel::setValues(const QRect &rect, const QString &val)
+{
+    TRACE_SCOPE("setValues");
+    if(offThread(false))
+    {
+        post([=](mergeModel &engine){ engine.setValues(rect,val); });
+        return;
+    }
+    auto area = rect & QRect(0,0,columnCount(),rowCount());
+    openEditGroup();
+    for(int row = area.top(); row <= area.bottom(); row++)
+        for(int col = area.left(); col <= area.right(); col++)
+            fillValue(row,col,val);
+    endEditGroup();
+}
+
+//one position of a setValues, inside its edit group
+void mergeModel::fillValue(int row, int col, const QString &val)
+{
+    TableCommand cmd;
+    cmd.type = TableCommand::SetValue;
+    cmd.row = row;
+    cmd.col = col;
+    cmd.after = val;
+    //reads the row's band in first when paged
+    if(!prepareCommand(cmd))
+        return;
+    auto cell = find(cmd.row,cmd.col);
+    if(!cell && !isImplicit(cmd.row,cmd.col))
+        return;
+    cmd.before = cell ? QString(cell->val) : QStringLiteral(CELLDEFAULT);
+    if(cmd.before != cmd.after)
+        runCommand(cmd);
+}
+
+QList<QStringList> mergeModel::values(const QRect &rect)
+{
+    TRACE_SCOPE("values");
+    QList<QStringList> lines;
+    for(int row = rect.top(); row <= rect.bottom(); row++)
+    {
+        if(!loadRow(row))
+            qCWarning(lcIO) << "Failed to read row" << row;
+        QStringList line;
+        for(int col = rect.left(); col <= rect.right(); col++)
+        {
+            auto i = m_index.owner(row,col);
+            if(i >= 0)
+            {
+                const auto &val = m_state.cells.val(i);
+                line.append(m_file && m_file->maps(val) ? QString(val.constData(),val.size()) : QString(val));
+            }
+            else
+                line.append(isImplicit(row,col) ? QStringLiteral(CELLDEFAULT) : QString());
+        }
+        lines.append(line);
+    }
+    //the bands read for this go back under the budget once it is copied out
+    evictFarBands();
+    return lines;
+}
+
+void mergeModel::ingest(int row, int col, const QString &val)
+{
+    m_ingest.push({row,col,val});
+    if(m_ingestScheduled.testAndSetOrdered(0,1))
+        QMetaObject::invokeMethod(this,[this]{ m_ingestTimer.start(); },Qt::QueuedConnection);
+}
+
+//apply what came in since the last frame, straight to the cells
+void mergeModel::drainIngest()
+{
+    TRACE_SCOPE("drainIngest");
+    //a queued engine edit would swap its own copy over them
+    if(m_engineJobs > 0)
+    {
+        m_ingestTimer.start();
+        return;
+    }
+    //cleared first: a value pushed from now on schedules the next frame
+    m_ingestScheduled.storeRelease(0);
+    QHash<QPair<int,int>,QString> latest;
+    IngestUpdate update;
+    while(m_ingest.pop(update))
+        latest.insert({update.row,update.col},std::move(update.val));
+
+    holdChanges();
+    for(auto it = latest.cbegin(); it != latest.cend(); ++it)
+    {
+        auto [row,col] = it.key();
+        //reading the band in would block the frame, the value waits for it
+        if(m_paged && row >= 0 && row < m_pageRows && col >= 0 && col < m_state.colMap.size() &&
+           (row >= m_state.rowMap.size() || !isResident(row)))
+            m_ingestPending[row].insert(col,it.value());
+        else
+            applyIngest(row,col,it.value());
+    }
+    releaseChanges();
+}
+
+void mergeModel::applyIngest(int row, int col, const QString &val)
+{
+    if(row < 0 || col < 0 || row >= m_state.rowMap.size() || col >= m_state.colMap.size())
+        return;
+    auto cell = find(row,col);
+    if(!cell && !isImplicit(row,col))
+        return;
+    if(cell ? QString(cell->val) == val : val == CELLDEFAULT)
         return;
+    setValue(row,col,val);
+}
+
+//value edits are only collected until the last release sends them, joined
+//into as few rectangles as cover them; past CHANGEDRECTS one bounding
+//rectangle is cheaper for the views than that many signals
+void mergeModel::holdChanges()
+{
+    if(m_heldChanges++ == 0)
+        m_changedRects.clear();
+}
+
+void mergeModel::releaseChanges()
+{
+    if(--m_heldChanges > 0)
+        return;
+    auto rects = std::move(m_changedRects);
+    m_changedRects.clear();
+    coalesce(rects);
+    if(rects.size() > CHANGEDRECTS)
+    {
+        QRect bounds;
+        for(auto &&rect : rects)
+            bounds |= rect;
+        rects = {bounds};
+    }
+    QRect table(0,0,columnCount(),rowCount());
+    for(auto &&rect : rects)
+    {
+        rect = rect.intersected(table);
+        if(!rect.isEmpty())
+            emit dataChanged(index(rect.top(),rect.left()),index(rect.bottom(),rect.right()),{Qt::EditRole});
+    }
+}
+
+//do or redo an edit, structural ones record what they remove on the way
+void mergeModel::applyCommand(TableCommand &cmd)
+{
+    switch(cmd.type)
+    {
+    case TableCommand::SetValue:
+        setValue(cmd.row,cmd.col,cmd.after);
+        break;
+    case TableCommand::InsertRows:
+        insertRowsImpl(cmd.row,cmd.count);
+        break;
+    case TableCommand::InsertColumns:
+        insertColumnsImpl(cmd.col,cmd.count);
+        break;
+    case TableCommand::RemoveRows:
+        cmd.removed.clear();
+        cmd.resized.clear();
+        removeRowsImpl(cmd.row,cmd.count,&cmd);
+        break;
+    case TableCommand::RemoveColumns:
+        cmd.removed.clear();
+        cmd.resized.clear();
+        removeColumnsImpl(cmd.col,cmd.count,&cmd);
+        break;
+    case TableCommand::Merge:
+    {
+        auto anchor = find(cmd.row,cmd.col);
+        Cell merged = anchor ? Cell(*anchor) : Cell();
+        if(!anchor)
+            merged.val = CELLDEFAULT;
+        merged.row = cmd.row;
+        merged.col = cmd.col;
+        merged.rowSpan = cmd.rowSpan;
+        merged.colSpan = cmd.colSpan;
+        cmd.removed = replaceCells(cmd.row,cmd.col,cmd.rowSpan,cmd.colSpan,{merged});
+        break;
+    }
+    case TableCommand::Split:
+    {
+        //a sparse table leaves the split area to the default
+        QList<Cell> cells;
+        for(int i = cmd.row;i < cmd.row+cmd.rowSpan && !m_state.sparse;i++)
+        {
+            for(int j =cmd.col;j < cmd.col+cmd.colSpan;j++)
+            {
+                Cell newCell;
+                newCell.row = i;
+                newCell.col = j;
+                newCell.val = CELLDEFAULT;
+                cells.append(newCell);
+            }
+        }
+        cmd.removed = replaceCells(cmd.row,cmd.col,cmd.rowSpan,cmd.colSpan,cells);
+        break;
+    }
+    case TableCommand::Group:
+        for(auto &child : cmd.children)
+            applyCommand(child);
+        break;
+    }
+}
+
+void mergeModel::revertCommand(const TableCommand &cmd)
+{
+    switch(cmd.type)
+    {
+    case TableCommand::SetValue:
+        setValue(cmd.row,cmd.col,cmd.before);
+        break;
+    case TableCommand::InsertRows:
+        removeRowsImpl(cmd.row,cmd.count,nullptr);
+        break;
+    case TableCommand::InsertColumns:
+        removeColumnsImpl(cmd.col,cmd.count,nullptr);
+        break;
+    case TableCommand::RemoveRows:
+        restoreRows(cmd);
+        break;
+    case TableCommand::RemoveColumns:
+        restoreColumns(cmd);
+        break;
+    case TableCommand::Merge:
+    case TableCommand::Split:
+        replaceCells(cmd.row,cmd.col,cmd.rowSpan,cmd.colSpan,cmd.removed);
+        break;
+    case TableCommand::Group:
+        for(auto i = cmd.children.size()-1; i >= 0; i--)
+            revertCommand(cmd.children.at(i));
+        break;
+    }
+}
+
+//commands address cells by position, they mean nothing for another table
+void mergeModel::clearHistory()
+{
+    m_undoStack.clear();
+    m_redoStack.clear();
+    m_editGroup.children.clear();
+    emit enableUndo(false);
+    emit enableRedo(false);
+}
+
+//whether a command moves cells rather than only setting values
+static bool isStructural(const TableCommand &cmd)
+{
+    if(cmd.type == TableCommand::Group)
+        return std::any_of(cmd.children.cbegin(),cmd.children.cend(),isStructural);
+    return cmd.type != TableCommand::SetValue;
+}
+
+void mergeModel::undo()
+{
+    TRACE_SCOPE("undo");
+    if(m_editDepth > 0)
+    {
+        qCWarning(lcModel) << "Cannot undo inside an edit group";
+        return;
+    }
+    flushEngine();
+    if(m_undoStack.isEmpty())
+    {
+        qCDebug(lcModel) << "Noting to undo";
+        emit enableUndo(false);
+        return;
+    }
+    if(!prepareCommand(m_undoStack.last()))
+        return;
+    auto cmd = m_undoStack.takeLast();
+    m_redoStack.push(cmd);
+    if(offThread(isStructural(cmd)))
+    {
+        post([cmd](mergeModel &engine){
+            engine.holdChanges();
+            engine.revertCommand(cmd);
+            engine.releaseChanges();
+        },false);
+    }else
+    {
+        holdChanges();
+        revertCommand(cmd);
+        releaseChanges();
+        printTable();
+    }
+
+    emit enableRedo(true);
+    emit enableUndo(!m_undoStack.isEmpty());
+}
+
+void mergeModel::redo()
+{
+    TRACE_SCOPE("redo");
+    if(m_editDepth > 0)
+    {
+        qCWarning(lcModel) << "Cannot redo inside an edit group";
+        return;
+    }
+    flushEngine();
+    if(m_redoStack.isEmpty())
+    {
+        qCDebug(lcModel) << "nothing to redo";
+        emit enableRedo(false);
+        return;
+    }
+
+    if(!prepareCommand(m_redoStack.last()))
+        return;
+    auto cmd = m_redoStack.takeLast();
+    if(offThread(isStructural(cmd)))
+    {
+        //applying records what the command removes anew, the undo entry
+        //comes back with the engine's result
+        post([cmd](mergeModel &engine){
+            auto again = cmd;
+            engine.holdChanges();
+            engine.applyCommand(again);
+            engine.releaseChanges();
+            engine.m_undoStack.push(again);
+        },false);
+    }else
+    {
+        holdChanges();
+        applyCommand(cmd);
+        releaseChanges();
+        m_undoStack.push(cmd);
+        printTable();
+    }
+
+    emit enableUndo(true);
+    emit enableRedo(!m_redoStack.isEmpty());
+}
+
+//drop merged anchors whose cell vanished or shrank back to a single cell
+void mergeModel::pruneMergedCells()
+{
+    for(int i = 0; i < m_state.mergedCells.size(); ++i)
+    {
+        auto &&[rowId,colId] = m_state.mergedCells.at(i);
+        auto cell = find(m_state.rowMap.toLogical(rowId),m_state.colMap.toLogical(colId));
+        if(!cell || (cell->rowSpan == 1 && cell->colSpan == 1))
+            m_state.mergedCells.removeAt(i--);
+    }
+}
+
+//a sparse table stores a cell once it differs from the default, and drops it when set back
+void mergeModel::setValue(int row, int col, const QString &val)
+{
+    auto cell = find(row,col);
+    if(!cell)
+    {
+        if(val != CELLDEFAULT)
+            appendCell(row,col,1,1,val);
+    }else if(m_state.sparse && val == CELLDEFAULT && cell->rowSpan == 1 && cell->colSpan == 1)
+    {
+        auto i = m_index.owner(row,col);
+        m_index.fill(row,col,1,1,-1);
+        removeCellAt(i);
+    }else
+    {
+        cell->val = val;
+        markDirty(cell->id);
+    }
+    if(m_heldChanges > 0)
+        m_changedRects.append(QRect(col,row,1,1));
+    else
+        emit dataChanged(index(row,col),index(row,col),{Qt::EditRole});
+}
+
+//a position of a sparse table with no cell; a paged table only knows once the band is read
+bool mergeModel::isImplicit(int row, int col) const
+{
+    if(!m_state.sparse || row < 0 || col < 0 || row >= m_state.rowMap.size() ||
+       col >= m_state.colMap.size() || m_index.owner(row,col) >= 0)
+        return false;
+    if(!m_paged)
+        return true;
+    auto it = m_bands.upperBound(row);
+    if(it == m_bands.cbegin())
+        return false;
+    --it;
+    return it->resident;
+}
+
+void mergeModel::setSparse(bool b)
+{
+    TRACE_SCOPE("setSparse");
+    flushEngine();
+    if(b == m_state.sparse || !fetchAll())
+        return;
+    m_state.sparse = b;
+    clearHistory();
+    if(b)
+    {
+        //highest position first, the cell swapped into a gap was already looked at
+        for(auto i = m_state.cells.size()-1; i >= 0; i--)
+        {
+            auto cell = m_state.cells[i];
+            if(cell.rowSpan == 1 && cell.colSpan == 1 && m_state.cells.val(i) == CELLDEFAULT)
+            {
+                m_index.fill(cellRow(cell),cellCol(cell),1,1,-1);
+                removeCellAt(i);
+            }
+        }
+    }else
+    {
+        for(int row = 0; row < m_state.rowMap.size(); row++)
+        {
+            for(int col = 0; col < m_state.colMap.size(); col++)
+            {
+                if(m_index.owner(row,col) < 0)
+                    appendCell(row,col);
+            }
+        }
+    }
+    checkExtents();
+}
 
-    saveCurrentState();
-    beginRemoveColumns(QModelIndex(),col,col);
-    for(int i = 0; i < m_state.cells.size(); ++i)
+//remove the cells anchored inside the area and put the given ones (logical
+//positions) in their place, returns what was removed in the same form
+QList<Cell> mergeModel::replaceCells(int top, int left, int height, int width, const QList<Cell> &cells)
+{
+    TRACE_SCOPE("replaceCells");
+    QList<Cell> removed;
+    for(int row = top; row < top + height;row++)
     {
-        auto &cell = m_state.cells[i];
+        for(int col = left; col < left + width;)
+        {
+            auto removeCell = find(row,col);
+            if(removeCell)
+            {
+                Cell cell = *removeCell;
+                auto i = m_index.owner(row,col);
+                if(cell.colSpan >1 || cell.rowSpan > 1)
+                {
+                    emit mergeSig(row,col);
+                    QPair<int,int> temp_p = {cell.row,cell.col};
+                    m_state.mergedCells.removeAll(temp_p);
+                }
+                qCDebug(lcDump).nospace() << "remove: ";
+                print(cell);
+                m_index.fill(row,col,cell.rowSpan,cell.colSpan,-1);
+                removeCellAt(i);
+
+                cell.row = row;
+                cell.col = col;
+                removed.append(cell);
+                col += cell.colSpan;
+            }else
+                col++;
+        }
+    }
 
-        //include or single
-        if(cell.col <= col && cell.col + cell.colSpan> col)
+    for(auto &&cell : cells)
+    {
+        appendCell(cell.row,cell.col,cell.rowSpan,cell.colSpan,cell.val,cell.id);
+        if(cell.rowSpan > 1 || cell.colSpan > 1)
         {
-            if(cell.colSpan > 1)
-                cell.colSpan--;
-            else{
-                m_state.cells.removeAt(i);
-                i--;
-            }
-        }else if(cell.col > col)
-            cell.col--;
+            m_state.mergedCells.append(qMakePair(m_state.rowMap.toPhysical(cell.row),
+                                                 m_state.colMap.toPhysical(cell.col)));
+            emit mergeSig(cell.row,cell.col,cell.rowSpan,cell.colSpan);
+        }
     }
+    checkExtents();
+    emit dataChanged(index(top,left),index(top+height-1,left+width-1),{Qt::DisplayRole});
+    return removed;
+}
 
-    endRemoveColumns();
+void mergeModel::insertRowsImpl(int row, int count)
+{
+    TRACE_SCOPE("insertRows");
+    beginInsertRows(QModelIndex(),row,row+count-1);
 
-    printTable();
+    //an empty table still shows one column to insert into; one whose rows
+    //were all cut keeps its columns
+    if(m_state.colMap.size() == 0 && m_state.rowMap.size() == 0)
+        m_state.colMap.reset(1);
+
+    //walk the row boundary once: a merged cell crossing it grows, a horizontal
+    //merge right above it is repeated on the new rows, everything else gets 1x1 cells
+    int columnCount = m_state.colMap.size();
+    QList<int> grown;
+    QList<QPair<int,int>> added;    //col, colSpan
+    for(int col=0;col < columnCount;)
+    {
+        auto spanCell = findSpanOnCol(row,col);
+        if(spanCell)
+        {
+            grown.append(m_index.owner(row,col));
+            col+=spanCell->colSpan;
+            continue;
+        }
+
+        //find the cell on the top of current Cell
+        auto above = find(row-1,col);
+        if(above && above->colSpan > 1)
+        {
+            added.append({col,above->colSpan});
+            col+=above->colSpan;
+        }else
+        {
+            added.append({col,1});
+            col++;
+        }
+    }
+
+    //cells below keep their physical rows, only the mapping moves
+    m_state.rowMap.insert(row,count);
+    m_index.insertRows(row,count);
+    recordShift(true,row,count);
+
+    for(auto i : grown)
+    {
+        auto cell = m_state.cells[i];
+        cell.rowSpan += count;
+        markDirty(cell.id);
+        m_index.fill(row,cellCol(cell),count,cell.colSpan,i);
+    }
+
+    QList<QPair<int,int>> mirrored;
+    for(int r = row; r < row+count; r++)
+    {
+        for(auto &&[col,colSpan] : added)
+        {
+            if(colSpan > 1 || !m_state.sparse)
+                appendCell(r,col,1,colSpan);
+            if(colSpan > 1)
+                mirrored.append({r,col});
+        }
+    }
+    for(auto &&[r,c] : mirrored)
+        m_state.mergedCells.append({m_state.rowMap.toPhysical(r),m_state.colMap.toPhysical(c)});
+    checkExtents();
+    endInsertRows();
+
+    for(auto &&[r,c] : mirrored)
+        emit mergeSig(r,c,1,find(r,c)->colSpan);
 }
 
-void mergeModel::insertRows_(int row, int count)
+void mergeModel::insertColumnsImpl(int col, int count)
 {
-    if(row < 0)
-        return;
-    saveCurrentState();
-    beginInsertRows(QModelIndex(),row,row+count-1);
+    TRACE_SCOPE("insertColumns");
+    beginInsertColumns(QModelIndex(), col,col+count-1);
+
+    if(m_state.rowMap.size() == 0 && m_state.colMap.size() == 0)
+        m_state.rowMap.reset(1);
+
+    int rowCount = m_state.rowMap.size();
+    QList<int> grown;
+    QList<QPair<int,int>> added;    //row, rowSpan
+    for(int row = 0; row < rowCount;)
+    {
+        auto spanCell = findSpanOnRow(row,col);
+        if(spanCell)
+        {
+            grown.append(m_index.owner(row,col));
+            row+=spanCell->rowSpan;
+            continue;
+        }
+
+        auto left = find(row,col-1);
+        if(left && left->rowSpan > 1)
+        {
+            added.append({row,left->rowSpan});
+            row+=left->rowSpan;
+        }else
+        {
+            added.append({row,1});
+            row++;
+        }
+    }
 
-    for(int i= 0; i < count; i++)
+    m_state.colMap.insert(col,count);
+    m_index.insertColumns(col,count);
+    recordShift(false,col,count);
+
+    for(auto i : grown)
     {
-        int columnCount = this->columnCount();
-        int rowCount = this->rowCount();
+        auto cell = m_state.cells[i];
+        cell.colSpan += count;
+        markDirty(cell.id);
+        m_index.fill(cellRow(cell),col,cell.rowSpan,count,i);
+    }
 
-        for(int col=0;col < columnCount;)
+    QList<QPair<int,int>> mirrored;
+    for(int c = col; c < col+count; c++)
+    {
+        for(auto &&[row,rowSpan] : added)
         {
-            assert(col >= 0);
-            Cell *spanCell = nullptr;
-            spanCell = findSpanOnCol(row,col);
+            if(rowSpan > 1 || !m_state.sparse)
+                appendCell(row,c,rowSpan,1);
+            if(rowSpan > 1)
+                mirrored.append({row,c});
+        }
+    }
+    for(auto &&[r,c] : mirrored)
+        m_state.mergedCells.append({m_state.rowMap.toPhysical(r),m_state.colMap.toPhysical(c)});
+    checkExtents();
+    endInsertColumns();
 
-            if(spanCell)
+    for(auto &&[r,c] : mirrored)
+        emit mergeSig(r,c,find(r,c)->rowSpan,1);
+}
+
+//cells inside the cut go away, merged cells crossing it shrink and an anchor
+//inside the cut moves to the first row after it. cmd, if given, records both
+void mergeModel::removeRowsImpl(int row, int count, TableCommand *cmd)
+{
+    TRACE_SCOPE("removeRows");
+    beginRemoveRows(QModelIndex(),row,row+count-1);
+
+    int last = row+count-1;
+    auto nextId = m_state.rowMap.toPhysical(row+count);
+    QList<int> removed;
+    QSet<int> seen;
+    for(int r = row; r <= last; r++)
+    {
+        for(int col = 0; col < m_state.colMap.size();)
+        {
+            auto i = m_index.owner(r,col);
+            if(i < 0)
             {
-                spanCell->rowSpan++;
-                //expand (col to col+spanCell->colSpan
-                for(int spanCol = col;spanCol < col+spanCell->colSpan;spanCol++)
-                    increaseCol(spanCol,row,rowCount);
+                col++;
+                continue;
+            }
+            auto cell = m_state.cells[i];
+            auto top = cellRow(cell);
+            col = cellCol(cell) + cell.colSpan;
+            if(seen.contains(i))
+                continue;
+            seen.insert(i);
 
-                col+=spanCell->colSpan;
+            Cell record = cell;
+            record.row = top;
+            record.col = cellCol(cell);
+            auto overlap = qMin(top+cell.rowSpan-1,last) - qMax(top,row) + 1;
+            if(overlap == cell.rowSpan)
+            {
+                removed.append(i);
+                if(cmd)
+                    cmd->removed.append(record);
                 continue;
             }
 
-            //find the cell on the top of current Cell
-            auto it = std::find_if(m_state.cells.begin(),m_state.cells.end(),[row,col](const Cell& cell)
+            if(cmd)
+                cmd->resized.append(record);
+            cell.rowSpan -= overlap;
+            markDirty(cell.id);
+            if(top >= row)
             {
-                return cell.row == row -1 && cell.col == col;
-            });
+                auto at = m_state.mergedCells.indexOf(qMakePair(cell.row,cell.col));
+                if(at >= 0)
+                    m_state.mergedCells[at].first = nextId;
+                cell.row = nextId;
+            }
+        }
+    }
+
+    m_index.removeRows(row,count);
+    m_state.rowMap.remove(row,count);
+    recordShift(true,row+count,-count);
+
+    //highest index first, so a cell still to be removed is never the one swapped in
+    std::sort(removed.begin(),removed.end(),std::greater<int>());
+    for(auto i : removed)
+        removeCellAt(i);
+    pruneMergedCells();
+    checkExtents();
 
-            if(it != m_state.cells.end())
+    endRemoveRows();
+}
+
+void mergeModel::removeColumnsImpl(int col, int count, TableCommand *cmd)
+{
+    TRACE_SCOPE("removeColumns");
+    beginRemoveColumns(QModelIndex(),col,col+count-1);
+
+    int last = col+count-1;
+    auto nextId = m_state.colMap.toPhysical(col+count);
+    QList<int> removed;
+    QSet<int> seen;
+    for(int c = col; c <= last; c++)
+    {
+        for(int row = 0; row < m_state.rowMap.size();)
+        {
+            auto i = m_index.owner(row,c);
+            if(i < 0)
             {
-                auto temp = *it;
-                appendAndIncreaseCol(row,col,rowCount,1,it->colSpan);
-                col+=temp.colSpan;
-                assert(temp.colSpan >0);
-            }else
+                row++;
+                continue;
+            }
+            auto cell = m_state.cells[i];
+            auto left = cellCol(cell);
+            row = cellRow(cell) + cell.rowSpan;
+            if(seen.contains(i))
+                continue;
+            seen.insert(i);
+
+            Cell record = cell;
+            record.row = cellRow(cell);
+            record.col = left;
+            auto overlap = qMin(left+cell.colSpan-1,last) - qMax(left,col) + 1;
+            if(overlap == cell.colSpan)
             {
-                appendAndIncreaseCol(row,col,rowCount);
-                col++;
+                removed.append(i);
+                if(cmd)
+                    cmd->removed.append(record);
+                continue;
+            }
+
+            if(cmd)
+                cmd->resized.append(record);
+            cell.colSpan -= overlap;
+            markDirty(cell.id);
+            if(left >= col)
+            {
+                auto at = m_state.mergedCells.indexOf(qMakePair(cell.row,cell.col));
+                if(at >= 0)
+                    m_state.mergedCells[at].second = nextId;
+                cell.col = nextId;
             }
         }
     }
+
+    m_index.removeColumns(col,count);
+    m_state.colMap.remove(col,count);
+    recordShift(false,col+count,-count);
+
+    std::sort(removed.begin(),removed.end(),std::greater<int>());
+    for(auto i : removed)
+        removeCellAt(i);
+    pruneMergedCells();
+    checkExtents();
+
+    endRemoveColumns();
+}
+
+//undo of removeRowsImpl: put blank rows back, then regrow and re-add the recorded cells
+void mergeModel::restoreRows(const TableCommand &cmd)
+{
+    TRACE_SCOPE("restoreRows");
+    beginInsertRows(QModelIndex(),cmd.row,cmd.row+cmd.count-1);
+    m_state.rowMap.insert(cmd.row,cmd.count);
+    m_index.insertRows(cmd.row,cmd.count);
+    recordShift(true,cmd.row,cmd.count);
+
+    QList<Cell> merged;
+    QList<QPair<int,int>> moved;
+    for(auto &&record : cmd.resized)
+    {
+        //an anchor that was inside the cut now sits right below it
+        auto row = record.row >= cmd.row ? cmd.row+cmd.count : record.row;
+        auto i = m_index.owner(row,record.col);
+        auto cell = m_state.cells[i];
+        if(row != record.row && (cell.rowSpan > 1 || cell.colSpan > 1))
+            moved.append(qMakePair(row,record.col));
+        QPair<int,int> temp_p = {cell.row,cell.col};
+        m_state.mergedCells.removeAll(temp_p);
+        cell.row = m_state.rowMap.toPhysical(record.row);
+        cell.rowSpan = record.rowSpan;
+        markDirty(cell.id);
+        m_index.fill(record.row,record.col,cell.rowSpan,cell.colSpan,i);
+        m_state.mergedCells.append(qMakePair(cell.row,cell.col));
+        merged.append(record);
+    }
+    for(auto &&record : cmd.removed)
+    {
+        appendCell(record.row,record.col,record.rowSpan,record.colSpan,record.val,record.id);
+        if(record.rowSpan > 1 || record.colSpan > 1)
+        {
+            m_state.mergedCells.append(qMakePair(m_state.rowMap.toPhysical(record.row),
+                                                 m_state.colMap.toPhysical(record.col)));
+            merged.append(record);
+        }
+    }
+    checkExtents();
     endInsertRows();
-    printTable();
+
+    //the view only regrows spans crossing the insertion point,
+    //spans re-anchored by the cut have to be dropped before being set again
+    for(auto &&p : moved)
+        emit mergeSig(p.first,p.second);
+    for(auto &&record : merged)
+        emit mergeSig(record.row,record.col,record.rowSpan,record.colSpan);
 }
 
-void mergeModel::insertRow_(int row)
+void mergeModel::restoreColumns(const TableCommand &cmd)
 {
-    insertRows_(row,1);
+    TRACE_SCOPE("restoreColumns");
+    beginInsertColumns(QModelIndex(),cmd.col,cmd.col+cmd.count-1);
+    m_state.colMap.insert(cmd.col,cmd.count);
+    m_index.insertColumns(cmd.col,cmd.count);
+    recordShift(false,cmd.col,cmd.count);
+
+    QList<Cell> merged;
+    QList<QPair<int,int>> moved;
+    for(auto &&record : cmd.resized)
+    {
+        auto col = record.col >= cmd.col ? cmd.col+cmd.count : record.col;
+        auto i = m_index.owner(record.row,col);
+        auto cell = m_state.cells[i];
+        if(col != record.col && (cell.rowSpan > 1 || cell.colSpan > 1))
+            moved.append(qMakePair(record.row,col));
+        QPair<int,int> temp_p = {cell.row,cell.col};
+        m_state.mergedCells.removeAll(temp_p);
+        cell.col = m_state.colMap.toPhysical(record.col);
+        cell.colSpan = record.colSpan;
+        markDirty(cell.id);
+        m_index.fill(record.row,record.col,cell.rowSpan,cell.colSpan,i);
+        m_state.mergedCells.append(qMakePair(cell.row,cell.col));
+        merged.append(record);
+    }
+    for(auto &&record : cmd.removed)
+    {
+        appendCell(record.row,record.col,record.rowSpan,record.colSpan,record.val,record.id);
+        if(record.rowSpan > 1 || record.colSpan > 1)
+        {
+            m_state.mergedCells.append(qMakePair(m_state.rowMap.toPhysical(record.row),
+                                                 m_state.colMap.toPhysical(record.col)));
+            merged.append(record);
+        }
+    }
+    checkExtents();
+    endInsertColumns();
+
+    for(auto &&p : moved)
+        emit mergeSig(p.first,p.second);
+    for(auto &&record : merged)
+        emit mergeSig(record.row,record.col,record.rowSpan,record.colSpan);
 }
 
-void mergeModel::insertColumn_(int col)
+void mergeModel::removeRow_(int row)
 {
-    insertColumns_(col,1);
+    removeRows_(row,1);
 }
 
-void mergeModel::insertColumns_(int col, int count)
+void mergeModel::removeColumn_(int col)
+{
+    removeColumns_(col,1);
+}
+
+void mergeModel::removeRows_(int first, int count)
 {
-    if(col < 0)
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.removeRows_(first,count); });
+        return;
+    }
+    if(first < 0 || count <= 0 || first+count > m_state.rowMap.size())
         return;
+    TableCommand cmd;
+    cmd.type = TableCommand::RemoveRows;
+    cmd.row = first;
+    cmd.count = count;
+    runCommand(cmd);
+    printTable();
+}
 
-    saveCurrentState();
-    beginInsertColumns(QModelIndex(), col,col+count-1);
+void mergeModel::removeColumns_(int first, int count)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.removeColumns_(first,count); });
+        return;
+    }
+    if(first < 0 || count <= 0 || first+count > m_state.colMap.size())
+        return;
+    TableCommand cmd;
+    cmd.type = TableCommand::RemoveColumns;
+    cmd.col = first;
+    cmd.count = count;
+    runCommand(cmd);
+    printTable();
+}
+
+//(first,count) ranges in any order, one undo step for all of them
+void mergeModel::removeRowRanges_(const QList<QPair<int,int>> &ranges)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.removeRowRanges_(ranges); });
+        return;
+    }
+    auto cmd = rangeGroup(TableCommand::RemoveRows,ranges,m_state.rowMap.size());
+    if(cmd.children.isEmpty())
+        return;
+    runCommand(cmd.children.size() == 1 ? cmd.children.first() : cmd);
+    printTable();
+}
 
-    for(int i = 0 ; i < count; i++)
+void mergeModel::removeColumnRanges_(const QList<QPair<int,int>> &ranges)
+{
+    if(offThread(true))
     {
-        int rowCount = this->rowCount();
-        int colCount = this->columnCount();
+        post([=](mergeModel &engine){ engine.removeColumnRanges_(ranges); });
+        return;
+    }
+    auto cmd = rangeGroup(TableCommand::RemoveColumns,ranges,m_state.colMap.size());
+    if(cmd.children.isEmpty())
+        return;
+    runCommand(cmd.children.size() == 1 ? cmd.children.first() : cmd);
+    printTable();
+}
 
-        for(int row = 0; row < rowCount;)
+//clip and join the ranges, then remove or insert them bottom up so the positions
+//of the ones still to go do not move. Insertions go before each run, or after it
+TableCommand mergeModel::rangeGroup(TableCommand::Type type, QList<QPair<int,int>> ranges, int size, bool after) const
+{
+    std::sort(ranges.begin(),ranges.end());
+    QList<QPair<int,int>> runs;
+    for(auto &&[first,count] : ranges)
+    {
+        auto begin = qMax(first,0);
+        auto end = qMin(first+count,size);
+        if(begin >= end)
+            continue;
+        if(!runs.isEmpty() && runs.last().first+runs.last().second >= begin)
         {
-            Cell *spanCell = nullptr;
-            spanCell = findSpanOnRow(row,col);
+            auto &last = runs.last();
+            last.second = qMax(last.first+last.second,end)-last.first;
+        }
+        else
+            runs.append({begin,end-begin});
+    }
 
-            if(spanCell)
-            {
-                spanCell->colSpan++;
-                for(int spanRow = row;spanRow < spanCell->rowSpan+row;spanRow++)
-                    increaseRow(spanRow,col,colCount);
-                row+=spanCell->rowSpan;
-                continue;
-            }
+    TableCommand group;
+    group.type = TableCommand::Group;
+    for(auto i = runs.size()-1; i >= 0; i--)
+    {
+        TableCommand cmd;
+        cmd.type = type;
+        auto pos = after ? runs[i].first+runs[i].second : runs[i].first;
+        if(type == TableCommand::RemoveRows || type == TableCommand::InsertRows)
+            cmd.row = pos;
+        else
+            cmd.col = pos;
+        cmd.count = runs[i].second;
+        group.children.append(cmd);
+    }
+    return group;
+}
 
-            auto it = std::find_if(m_state.cells.begin(),m_state.cells.end(),[row,col](const Cell& cell)
-            {
-                return cell.col == col-1 && cell.row == row;
-            });
+//(first,count) ranges in any order, each joined run gets as many new rows
+void mergeModel::insertRowRanges_(const QList<QPair<int,int>> &ranges, bool after)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.insertRowRanges_(ranges,after); });
+        return;
+    }
+    auto cmd = rangeGroup(TableCommand::InsertRows,ranges,m_state.rowMap.size(),after);
+    if(cmd.children.isEmpty())
+        return;
+    runCommand(cmd.children.size() == 1 ? cmd.children.first() : cmd);
+    printTable();
+}
 
-            if(it != m_state.cells.end())
-            {
-                auto temp = *it;
-                appendAndIncreseRow(row,col,colCount,it->rowSpan,1);
-                assert(temp.rowSpan>0);
-                row+=temp.rowSpan;
-            }else
-            {
-                appendAndIncreseRow(row,col,colCount);
-                row++;
-            }
-        }
+void mergeModel::insertColumnRanges_(const QList<QPair<int,int>> &ranges, bool after)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.insertColumnRanges_(ranges,after); });
+        return;
     }
+    auto cmd = rangeGroup(TableCommand::InsertColumns,ranges,m_state.colMap.size(),after);
+    if(cmd.children.isEmpty())
+        return;
+    runCommand(cmd.children.size() == 1 ? cmd.children.first() : cmd);
+    printTable();
+}
 
-    endInsertColumns();
+void mergeModel::insertRows_(int row, int count)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.insertRows_(row,count); });
+        return;
+    }
+    if(row < 0 || row > m_state.rowMap.size() || count <= 0)
+        return;
+    TableCommand cmd;
+    cmd.type = TableCommand::InsertRows;
+    cmd.row = row;
+    cmd.count = count;
+    runCommand(cmd);
     printTable();
 }
 
-void mergeModel::split(int splitRow, int splitCol)
+void mergeModel::insertRow_(int row)
 {
-    saveCurrentState();
-    //use a deep copy, iterator maybe invalid
-    Cell cell = *find(splitRow,splitCol);
-    emit mergeSig(splitRow,splitCol);
-    QPair<int,int> temp_p= {splitRow,splitCol};
-    m_state.mergedCells.removeAll(temp_p);
-    m_state.cells.removeAll(cell);
+    insertRows_(row,1);
+}
 
-    qDebug() << "split row range: "<<cell.row << "to"<<cell.row+cell.rowSpan;
-    qDebug() << "split col range: "<<cell.col<<"to"<<cell.col+cell.colSpan;
+void mergeModel::insertColumn_(int col)
+{
+    insertColumns_(col,1);
+}
 
-    for(int i = cell.row;i < cell.row+cell.rowSpan;i++)
+void mergeModel::insertColumns_(int col, int count)
+{
+    if(offThread(true))
     {
-        for(int j =cell.col;j < cell.colSpan + cell.col;j++)
-        {
-            qDebug() << "pos: "<<i<<","<<j;
-            Cell newCell;
-            newCell.col = j;
-            newCell.row = i;
-            newCell.val = "Cell";
-            m_state.cells.append(newCell);
-            qDebug().nospace() << "append new cell";
-            print(newCell);
-        }
+        post([=](mergeModel &engine){ engine.insertColumns_(col,count); });
+        return;
     }
-    emit dataChanged(index(splitRow,splitCol),index(cell.rowSpan-1,cell.colSpan-1));
+    if(col < 0 || col > m_state.colMap.size() || count <= 0)
+        return;
 
+    TableCommand cmd;
+    cmd.type = TableCommand::InsertColumns;
+    cmd.col = col;
+    cmd.count = count;
+    runCommand(cmd);
     printTable();
 }
 
-void mergeModel::merge(int top, int left, int width, int height)
+void mergeModel::split(int splitRow, int splitCol)
 {
-    saveCurrentState();
-    if(top <0 || left < 0 || width<=0 || height <=0)
+    if(offThread(true))
     {
-        qDebug() << "invalid parameter";
+        post([=](mergeModel &engine){ engine.split(splitRow,splitCol); });
         return;
     }
+    auto cell = find(splitRow,splitCol);
+    if(!cell)
+        return;
+
+    qCDebug(lcModel) << "split row range: "<<splitRow << "to"<<splitRow+cell->rowSpan;
+    qCDebug(lcModel) << "split col range: "<<splitCol<<"to"<<splitCol+cell->colSpan;
+
+    TableCommand cmd;
+    cmd.type = TableCommand::Split;
+    cmd.row = splitRow;
+    cmd.col = splitCol;
+    cmd.rowSpan = cell->rowSpan;
+    cmd.colSpan = cell->colSpan;
+    runCommand(cmd);
+
+    printTable();
+}
 
-    auto curCellPtr = find(top,left);
-    if(!curCellPtr)
+//every merged cell reaching into the area, found from the spans rather than
+//by visiting the area, so whole columns cost no more than the merged cells
+void mergeModel::splitArea(int top, int left, int width, int height)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.splitArea(top,left,width,height); });
+        return;
+    }
+    if(m_paged && !fetchAll())
+        return;
+    QRect area = QRect(left,top,width,height) & QRect(0,0,m_state.colMap.size(),m_state.rowMap.size());
+    if(area.isEmpty())
         return;
-    auto curCell = *curCellPtr;
 
-    for(int row = top; row < top + height;row++)
+    //the merged cells reaching into the area, from the index over it. Each is
+    //taken where it first enters the area, a row walk skips the rest of it
+    //and stops where the row's storage ends
+    QList<int> merged;
+    for(int row = area.top(); row <= area.bottom(); row++)
     {
-        for(int col = left; col < left + width;)
+        auto right = qMin(area.right(),m_index.rowSize(row)-1);
+        for(int col = area.left(); col <= right;)
         {
-            auto removeCell = find(row,col);
-            if(removeCell)
+            auto i = m_index.owner(row,col);
+            if(i < 0)
             {
-                col += removeCell->colSpan;
-                if(removeCell->colSpan >1 || removeCell->rowSpan > 1)
-                {
-                    emit mergeSig(removeCell->row,removeCell->col);
-                    QPair<int,int> temp_p = {removeCell->row,removeCell->col};
-                    m_state.mergedCells.removeAll(temp_p);
-                }
-                qDebug().nospace() << "remove: ";
-                print(*removeCell);
-                m_state.cells.removeOne(*removeCell);
-            }else
                 col++;
+                continue;
+            }
+            auto rect = rectAt(i);
+            col = rect.right()+1;
+            if((rect.height() > 1 || rect.width() > 1) && row == qMax(rect.top(),area.top()))
+                merged.append(i);
         }
     }
 
-    curCell.colSpan = width;
-    curCell.rowSpan = height;
-    m_state.cells.append(curCell);
-    m_state.mergedCells.append({curCell.row,curCell.col});
-    emit mergeSig(curCell.row,curCell.col,curCell.rowSpan,curCell.colSpan);
-    emit dataChanged(index(top,left),index(top+height-1,left+width-1),{Qt::DisplayRole});
-
+    TableCommand group;
+    group.type = TableCommand::Group;
+    for(auto i : merged)
+    {
+        auto rect = rectAt(i);
+        TableCommand cmd;
+        cmd.type = TableCommand::Split;
+        cmd.row = rect.top();
+        cmd.col = rect.left();
+        cmd.rowSpan = rect.height();
+        cmd.colSpan = rect.width();
+        group.children.append(cmd);
+    }
+    if(group.children.isEmpty())
+        return;
+    runCommand(group.children.size() == 1 ? group.children.first() : group);
     printTable();
 }
 
+void mergeModel::merge(int top, int left, int width, int height)
+{
+    if(offThread(true))
+    {
+        post([=](mergeModel &engine){ engine.merge(top,left,width,height); });
+        return;
+    }
+    if(top <0 || left < 0 || width<=0 || height <=0 ||
+        top+height > m_state.rowMap.size() || left+width > m_state.colMap.size())
+    {
+        qCWarning(lcModel) << "invalid parameter";
+        return;
+    }
 
+    if(m_paged && !fetchAll())
+        return;
+    //a merged cell partly inside is taken in whole
+    auto area = coveringRect(QRect(left,top,width,height));
+    if(area != QRect(left,top,width,height))
+        qCDebug(lcModel) << "merge grown to" << area;
+    if(!find(area.top(),area.left()) && !isImplicit(area.top(),area.left()))
+        return;
 
+    TableCommand cmd;
+    cmd.type = TableCommand::Merge;
+    cmd.row = area.top();
+    cmd.col = area.left();
+    cmd.rowSpan = area.height();
+    cmd.colSpan = area.width();
+    runCommand(cmd);
 
+    printTable();
+}
@@ -1,31 +1,103 @@
 #pragma once
 
 #include <QAbstractTableModel>
-#include <QSqlDatabase>
-#include <QStack>
-
-#define MAXSTACKSIZE 100
-struct Cell{
-    QString val = "temp";
-    // int row;
-    // int column;
-    int rowSpan = 1;
-    int colSpan = 1;
-    int row;
-    int col;
-
-    bool operator==(const Cell&temp) const
-    {
-        return this->rowSpan == temp.rowSpan && this->colSpan == temp.colSpan &&
-               this->col == temp.col && this->row == temp.row && this->val == temp.val;
-    }
-};
+#include <QSet>
+#include <QHash>
+#include <QMap>
+#include <QRect>
+#include <QStringList>
+#include <QFuture>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QTimer>
+#include <functional>
+#include <memory>
+#include <optional>
+#include "cellIndex.h"
+#include "cellStore.h"
+#include "axisMap.h"
+#include "ingestQueue.h"
+#include "undoHistory.h"
 
+class tableFile;
+class tableBackend;
+
+#define DBFILE "cell.db"                   //database the Db functions use unless told otherwise
+#define CELLDEFAULT "Cell"                  //value of a new cell, and of every position a sparse table leaves out
+#define PAGEBANDSIZE 512                    //rows read at a time by a paged table
+#define PAGEBUDGET (64*1024*1024)           //bytes of cells a paged table keeps before evicting
+#define ENGINECELLS 100000                  //cells from which structural edits run off the GUI thread
+#define INGESTFRAME 16                      //ms live values wait to be drained together
+#define CHANGEDRECTS 64                     //changed rectangles sent before one bounding them is
 struct TableState {
-    QList<Cell> cells;
-    QList<QPair<int,int>> mergedCells;
+    cellStore cells;
+    QList<QPair<int,int>> mergedCells;     //physical ids of merged anchors, positions while loading
+    //the axis sizes are the table extents
+    axisMap rowMap;
+    axisMap colMap;
     bool firstHeaderRow = false;
     bool firstHeaderCol = false;
+    //only cells with another value, or merged, are kept; the axis sizes
+    //alone give the extents and every other position reads CELLDEFAULT
+    bool sparse = false;
+};
+
+//what savetoDb still has to write since the last save or load
+struct SaveJournal {
+    //positions at or past 'from' on one axis moved by 'delta'
+    struct Shift {
+        bool rows;
+        int from;
+        int delta;
+    };
+    bool full = true;       //nothing in the database matches the table yet
+    QString table;          //the table the cells were saved to or loaded from
+    QSet<int> dirty;        //ids of cells to write
+    QSet<int> removed;      //ids of cells to delete
+    QList<Shift> shifts;
+};
+
+//rows of a paged table read in one go. Bands start where the previous one
+//ends and are grown over their merged cells, so no cell crosses two bands
+struct PageBand {
+    int last = 0;           //last row of the band
+    bool resident = false;  //false until read, and again once evicted
+    qint64 bytes = 0;       //estimated memory of its cells while resident
+};
+
+//estimated bytes the model holds, see memoryUsage()
+struct MemoryUsage {
+    qint64 cells = 0;           //geometry, handles, the axes and the id lookup
+    qint64 strings = 0;         //the pooled values
+    qint64 mergedIndex = 0;     //ownership grid and merged anchors
+    qint64 undo = 0;            //packed commands at their compressed size
+    qint64 redo = 0;
+    qint64 spilled = 0;         //history in the temp file, not counted in total()
+    qint64 total() const { return cells+strings+mergedIndex+undo+redo; }
+};
+
+//a notification the engine gave while editing, replayed to the views on publishing.
+//Rows and columns use row/col as first and rowSpan/colSpan as count
+struct EngineNote {
+    enum Kind { InsertRows, RemoveRows, InsertColumns, RemoveColumns, Span, Changed };
+    Kind kind = Changed;
+    int row = 0;
+    int col = 0;
+    int rowSpan = 1;
+    int colSpan = 1;
+};
+
+//the table as an engine job left it, swapped into the model in one step
+struct EngineResult {
+    TableState state;
+    cellIndex index;
+    QHash<int,int> byId;
+    int nextId = 0;
+    SaveJournal journal;            //what the job changed, on top of the model's
+    QList<TableCommand> done;       //undo entries the job recorded
+    bool newEdit = true;            //false for a redo, its entry leaves the redo stack as it is
+    QList<EngineNote> notes;
 };
 
 class mergeModel : public QAbstractTableModel{
@@ -33,6 +105,7 @@ class mergeModel : public QAbstractTableModel{
 
 public:
     mergeModel(QObject *parent);
+    ~mergeModel() override;
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &parent = QModelIndex(), int role = Qt::DisplayRole)const override;
@@ -44,37 +117,158 @@ public:
     bool loadFromDb(const QString& tableName);
     void savetoJson(const QString &fileName);
     void loadFromJson(const QString &fileName);
+    //same as above on a worker thread, from a snapshot of the table.
+    //A load is swapped into the model in one step once it has been read
+    QFuture<bool> savetoDbAsync(const QString& tableName);
+    QFuture<bool> loadFromDbAsync(const QString& tableName);
+    QFuture<bool> savetoJsonAsync(const QString &fileName);
+    QFuture<bool> loadFromJsonAsync(const QString &fileName);
+    //open a table without reading it all: rows are read in bands as the view
+    //scrolls down through fetchMore, bands far from the view are dropped once
+    //the budget is exceeded and read again when scrolled back to
+    bool loadFromDbPaged(const QString& tableName, int bandSize = PAGEBANDSIZE);
+    void setPageBudget(qint64 bytes);
+    //binary table file, opened by mapping it: see tableFile
+    bool savetoBinary(const QString &fileName);
+    bool loadFromBinary(const QString &fileName);
+    //a whole table through any backend, see tableBackend::forFile
+    bool load(tableBackend &backend);
+    bool save(tableBackend &backend);
+    //the database is only opened once a Db function needs it. They go through
+    //the registered database backend, see tableBackend::forTable
+    void setDatabaseFile(const QString &fileName);
+    QString databaseFile() const { return m_dbFile; }
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     void restoreTableMergeState(bool init = false);
     void clearTableMergeState();
     void initTable(const QString& tableName);
-    Cell* find(int row, int col);
+    std::optional<cellRef> find(int row, int col);
+    std::optional<Cell> cellAt(int row, int col) const;
+    //handles stay valid through edits elsewhere in the table, until the cell
+    //itself is removed or another table is loaded
+    cellHandle handleAt(int row, int col) const;
+    std::optional<cellRef> find(cellHandle handle);
+    QRect cellRect(cellHandle handle) const;
+    //switching stores or drops the default cells, and clears the undo history
+    void setSparse(bool b);
+    bool isSparse() const { return m_state.sparse; }
     void setFirstRowHeader(bool b);
     void setFirstColHeader(bool b);
+    //edits between these are undone in one step and announced as a few rectangles.
+    //Groups nest, the outermost end records them. On a table big enough for the
+    //engine the edits are only collected, and the outermost end hands them to it
+    //as one job: until that is published the table reads as before the group
+    void beginEditGroup();
+    void endEditGroup();
+    //fill a block of values from top,left in one undo step; rows past the table
+    //are dropped, as are positions covered by a merged cell
+    void setValues(int top, int left, const QList<QStringList> &block);
+    //one value over a rectangle, same rules
+    void setValues(const QRect &rect, const QString &val);
+    //the values of a rectangle row by row, reading evicted bands back in for it
+    QList<QStringList> values(const QRect &rect);
+    //thread safe: live values are applied once per frame, the last one for a
+    //position wins. They bypass undo but are saved like any edit. A paged row
+    //not in memory gets its value when its band is read. Positions are the
+    //ones at the frame, not at the push: producers must not run alongside
+    //row or column inserts and removes
+    void ingest(int row, int col, const QString &val);
+    //block until the structural edits running off the GUI thread are in the table
+    void waitForEdits();
+    MemoryUsage memoryUsage() const;
+    //bytes each of the undo and redo stacks keeps in memory, see undoHistory
+    void setUndoBudget(qint64 bytes);
 
 private:
-    void increaseCol(int col, int rowBegin,int totalRow);
-    void increaseRow(int row, int colBegin,int totalColumn);
+    //the engine: a copy of the table no view watches, edited on m_ioPool
+    mergeModel(const TableState &state, int nextId);
+    bool offThread(bool structural) const;
+    void post(const std::function<void(mergeModel&)> &edit, bool newEdit = true);
+    void openEditGroup();
+    void publishEngine();
+    void publish(EngineResult &result);
+    void flushEngine();
+    void drainIngest();
+    std::shared_ptr<tableBackend> backend(const QString &tableName);
     void print(Cell cell);
     void printTable();
-    void sortTable();
-    void appendAndIncreseRow(int row, int col,int totalCol,
-                             int rowSpan = 1,int colSpan = 1,const QString& val = "Cell");
-    void appendAndIncreaseCol(int row, int col, int totalRow,
-                             int rowSpan = 1, int colSpan =1, const QString& val = "Cell");
-
-    Cell* findSpanOnCol(int row,int col);
-    Cell* findSpanOnRow(int row,int col);
-    void saveCurrentState();
+    QList<Cell> sortTable() const;
+    void appendCell(int row, int col, int rowSpan = 1, int colSpan = 1, const QString& val = CELLDEFAULT, int id = -1);
+    void removeCellAt(int i);
+    void dropCellAt(int i);
+    void addLoadedCell(Cell cell);
+    void markDirty(int id);
+    void markRemoved(int id);
+    void recordShift(bool rows, int from, int delta);
+    void setValue(int row, int col, const QString &val);
+    void fillValue(int row, int col, const QString &val);
+    QList<Cell> replaceCells(int top, int left, int height, int width, const QList<Cell> &cells);
+    void insertRowsImpl(int row, int count);
+    void insertColumnsImpl(int col, int count);
+    void removeRowsImpl(int row, int count, TableCommand *cmd);
+    void removeColumnsImpl(int col, int count, TableCommand *cmd);
+    void restoreRows(const TableCommand &cmd);
+    void restoreColumns(const TableCommand &cmd);
+    void rebuildIndex();
+    void adoptAxes(TableState &next) const;
+    void compactAxes();
+    void applyState(TableState &&next);
+    void installState(TableState &next, const QString &tableName, std::shared_ptr<tableFile> file = {});
+    bool fullSave(const QString &tableName) const;
+    SaveJournal takeJournal(const QString &tableName, bool full, QList<int> &dirty);
+    bool writeSnapshot(tableBackend &backend, const TableState &state,
+                       const SaveJournal &journal, const QList<int> &dirty,
+                       const std::function<bool(qint64,qint64)> &progress);
+    void appendBand();
+    QList<QRect> loadBand(int first);
+    bool reloadBand(int first);
+    void applyPending(int first);
+    void applyIngest(int row, int col, const QString &val);
+    QList<int> bandCells(int first) const;
+    void evictBand(int first, QList<int> cells);
+    void evictFarBands();
+    void requestBand(int row) const;
+    void loadWantedBands();
+    bool fetchAll();
+    bool isImplicit(int row, int col) const;
+    bool prepareCommand(const TableCommand &cmd);
+    bool isResident(int row) const;
+    bool loadRow(int row);
+    void checkExtents() const;
+    void pruneMergedCells();
+    QRect rectAt(int i) const;
+    QRect coveringRect(QRect rect) const;
+    int cellRow(const Cell &cell) const;
+    int cellCol(const Cell &cell) const;
+
+    std::optional<cellRef> findSpanOnCol(int row,int col);
+    std::optional<cellRef> findSpanOnRow(int row,int col);
+    void runCommand(TableCommand &cmd);
+    void applyCommand(TableCommand &cmd);
+    void revertCommand(const TableCommand &cmd);
+    void clearHistory();
+    void pushUndo(const TableCommand &cmd);
+    void holdChanges();
+    void releaseChanges();
+    TableCommand rangeGroup(TableCommand::Type type, QList<QPair<int,int>> ranges, int size, bool after = false) const;
 public slots:
 
 //operate need to store
     void removeRow_(int row);
     void removeColumn_(int col);
+    void removeRows_(int first, int count);
+    void removeColumns_(int first, int count);
+    void removeRowRanges_(const QList<QPair<int,int>> &ranges);
+    void removeColumnRanges_(const QList<QPair<int,int>> &ranges);
     void insertRows_(int row, int count);
     void insertRow_(int row);
     void insertColumn_(int col);
     void insertColumns_(int col, int count);
+    void insertRowRanges_(const QList<QPair<int,int>> &ranges, bool after = false);
+    void insertColumnRanges_(const QList<QPair<int,int>> &ranges, bool after = false);
     void split(int row, int col);
+    void splitArea(int top, int left, int width, int height);
     void merge(int top, int left, int width, int height);
     void undo();
     void redo();
@@ -88,7 +282,48 @@ signals:
 
 private:
     TableState m_state;
-    QStack<TableState> m_undoStack;
-    QStack<TableState> m_redoStack;
-    QSqlDatabase m_db;
+    undoHistory m_undoStack;
+    undoHistory m_redoStack;
+    int m_editDepth = 0;
+    TableCommand m_editGroup;   //commands run since the outermost beginEditGroup
+    bool m_groupPosted = false; //the open group goes to the engine, its edits wait in m_groupEdits
+    QList<std::function<void(mergeModel&)>> m_groupEdits;
+    int m_heldChanges = 0;      //while set, setValue adds to m_changedRects instead of emitting
+    QList<QRect> m_changedRects;
+    cellIndex m_index;
+    QHash<int,int> m_byId;      //Cell::id -> position in m_state.cells
+    int m_nextId = 0;
+    SaveJournal m_journal;
+    QAtomicInt m_saveFailed;    //set by a failed save until a full one succeeds
+    //changes of the async saves still running, not in the database yet
+    SaveJournal m_saving;
+    int m_savesRunning = 0;
+    //paging, from loadFromDbPaged until every band has been read once an edit needs them all.
+    //Rows are only appended meanwhile, so physical row ids equal the database rows
+    bool m_paged = false;
+    std::shared_ptr<tableBackend> m_pageBackend;     //the table bands are read from
+    int m_pageRows = 0;         //rows of the stored table
+    int m_bandSize = PAGEBANDSIZE;
+    qint64 m_pageBudget = PAGEBUDGET;
+    QMap<int,PageBand> m_bands;             //by first row
+    mutable int m_pageFocus = 0;            //row the view painted last
+    mutable QSet<int> m_wantedBands;        //evicted bands the view painted
+    QMap<int,QHash<int,QString>> m_ingestPending;   //ingested values by row and col, for rows not in memory
+    QString m_dbFile = DBFILE;
+    QHash<QString,std::shared_ptr<tableBackend>> m_tables;     //of m_dbFile, by name
+    std::shared_ptr<tableFile> m_file;      //mapped file the loaded values still point into
+    //edits queued to the engine. It only lives while some are, and only
+    //the worker touches it meanwhile; results come back through m_published
+    bool m_detached = false;                //this is an engine
+    int m_engineJobs = 0;
+    std::unique_ptr<mergeModel> m_engine;
+    QList<EngineNote> m_notes;              //engine only
+    QMutex m_publishLock;
+    QList<EngineResult> m_published;
+    ingestQueue m_ingest;
+    QAtomicInt m_ingestScheduled;           //set from the first push until the drain starts
+    QTimer m_ingestTimer;
+    //one job at a time keeps saves and loads in order; last member, so
+    //destroying the model waits for a running job before anything else goes
+    QThreadPool m_ioPool;
 };
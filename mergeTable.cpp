@@ -1,6 +1,33 @@
 #include "mergeTable.h"
 #include "./ui_mergeTable.h"
 #include <QMenuBar>
+#include <QFileInfo>
+#include <QClipboard>
+#include <QGuiApplication>
+#include <QItemSelection>
+
+//the selection is read as its ranges, never as one index per selected cell
+static QRect selectedRect(const QItemSelection &selection)
+{
+    QRect area;
+    for(auto &range : selection)
+        area |= QRect(range.left(),range.top(),range.width(),range.height());
+    return area;
+}
+
+//(first,count) of the rows or columns the ranges cover, left for the model to join
+static QList<QPair<int,int>> selectedRuns(const QItemSelection &selection, Qt::Orientation orientation)
+{
+    QList<QPair<int,int>> runs;
+    for(auto &range : selection)
+    {
+        if(orientation == Qt::Vertical)
+            runs.append({range.top(),range.height()});
+        else
+            runs.append({range.left(),range.width()});
+    }
+    return runs;
+}
 
 mergeTable::mergeTable(QWidget *parent)
     : QWidget(parent)
@@ -15,9 +42,12 @@ mergeTable::mergeTable(QWidget *parent)
 
     createConnection();
     m_model->initTable("cellTable");
-    m_model->loadFromDb("cellTable");
+    //a table file saved after the database opens without reading anything
+    QFileInfo binary("data.mtab");
+    if(!binary.exists() || binary.lastModified() < QFileInfo(m_model->databaseFile()).lastModified() ||
+       !m_model->loadFromBinary("data.mtab"))
+        m_model->loadFromDbPaged("cellTable");
     // m_model->loadFromJson("data.json");
-    m_model->restoreTableMergeState(true);
 }
 
 mergeTable::~mergeTable()
@@ -43,27 +73,41 @@ void mergeTable::createConnection()
     auto insertColBackAction = new QAction("insertColumn_Back",this);
     auto saveDbAction = new QAction("savetoDb",this);
     auto saveJsonAction = new QAction("savetoJson",this);
+    auto saveBinaryAction = new QAction("savetoBinary",this);
     auto redoAction = new QAction("redo",this);
     auto undoAction = new QAction("undo",this);
     auto firstRow = new QAction("First Row");
     auto firstCol = new QAction("First Column");
+    auto sparseAction = new QAction("Sparse Storage",this);
+    auto copyAction = new QAction("copy",this);
+    auto pasteAction = new QAction("paste",this);
     firstRow->setCheckable(true);
     firstCol->setCheckable(true);
+    sparseAction->setCheckable(true);
 
     redoAction->setEnabled(false);
     undoAction->setEnabled(false);
     redoAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_R));
     undoAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_Z));
-    ui->tableView->addActions({redoAction,undoAction});
+    copyAction->setShortcut(QKeySequence::Copy);
+    pasteAction->setShortcut(QKeySequence::Paste);
+    ui->tableView->addActions({redoAction,undoAction,copyAction,pasteAction});
 
     auto splitAction = new QAction("split",this);
     menu.addActions({mergeAction,removeRowAction,insertRowFrontAction,
                     insertRowBackAction,removeColAction,insertColFrontAction,
                      insertColBackAction,splitAction});
     menu.addSeparator();
-    menu.addActions({redoAction,undoAction,saveDbAction,saveJsonAction});
+    menu.addActions({redoAction,undoAction,copyAction,pasteAction});
     menu.addSeparator();
-    menu.addActions({firstRow,firstCol});
+    menu.addActions({saveDbAction,saveJsonAction,saveBinaryAction});
+    menu.addSeparator();
+    menu.addActions({firstRow,firstCol,sparseAction});
+    //a load brings the mode of what it read
+    connect(&menu,&QMenu::aboutToShow,this,[this,sparseAction]{
+        sparseAction->setChecked(m_model->isSparse());
+    });
+    connect(sparseAction,&QAction::triggered,m_model,&mergeModel::setSparse);
 
     connect(firstRow,&QAction::triggered,this,[this](bool b){
         if(b){
@@ -95,20 +139,59 @@ void mergeTable::createConnection()
     connect(redoAction, &QAction::triggered,m_model,&mergeModel::redo);
     connect(undoAction,&QAction::triggered,m_model,&mergeModel::undo);
 
-    connect(saveJsonAction,&QAction::triggered,this,[this]{
-        m_model->savetoJson("data.json");
+    //the selection as tab separated lines, the way spreadsheets exchange it
+    connect(copyAction,&QAction::triggered,this,[this]{
+        auto area = selectedRect(ui->tableView->selectionModel()->selection());
+        if(area.isEmpty())
+            return;
+        QStringList lines;
+        for(auto &line : m_model->values(area))
+            lines.append(line.join('\t'));
+        QGuiApplication::clipboard()->setText(lines.join('\n'));
     });
 
-    connect(splitAction,&QAction::triggered,this,[this](){
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        for(auto &index : selectIndexes)
+    //a single value fills the whole selection, a block goes from its top left
+    connect(pasteAction,&QAction::triggered,this,[this]{
+        auto text = QGuiApplication::clipboard()->text();
+        if(text.endsWith('\n'))
+            text.chop(1);
+        if(text.isEmpty())
+            return;
+        QList<QStringList> block;
+        for(auto &line : text.split('\n'))
         {
-            auto cell = m_model->find(index.row(),index.column());
-            if(cell && (cell->colSpan >1 || cell->rowSpan>1))
-            {
-                m_model->split(cell->row,cell->col);
-            }
+            if(line.endsWith('\r'))
+                line.chop(1);
+            block.append(line.split('\t'));
         }
+
+        auto area = selectedRect(ui->tableView->selectionModel()->selection());
+        if(area.isEmpty())
+        {
+            auto current = ui->tableView->currentIndex();
+            if(!current.isValid())
+                return;
+            area = QRect(current.column(),current.row(),1,1);
+        }
+        if(block.size() == 1 && block.first().size() == 1)
+            m_model->setValues(area,block.first().first());
+        else
+            m_model->setValues(area.top(),area.left(),block);
+    });
+
+    connect(saveJsonAction,&QAction::triggered,this,[this]{
+        m_model->savetoJsonAsync("data.json");
+    });
+
+    connect(saveBinaryAction,&QAction::triggered,this,[this]{
+        m_model->savetoBinary("data.mtab");
+    });
+
+    connect(splitAction,&QAction::triggered,this,[this](){
+        m_model->beginEditGroup();
+        for(auto &range : ui->tableView->selectionModel()->selection())
+            m_model->splitArea(range.top(),range.left(),range.width(),range.height());
+        m_model->endEditGroup();
     });
 
     connect(m_model,&mergeModel::mergeSig,this,[this](int row, int col, int rowSpan, int colSpan){
@@ -120,128 +203,42 @@ void mergeTable::createConnection()
     // });
 
     connect(saveDbAction,&QAction::triggered,this,[this](){
-        m_model->savetoDb("cellTable");
+        m_model->savetoDbAsync("cellTable");
     });
 
     connect(mergeAction,&QAction::triggered,this,[this]
     {
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        int top;
-        int left;
-        int width = 1;
-        int height = 1;
-        auto topLeftIndex = selectIndexes.first();
-        top = topLeftIndex.row();
-        left = topLeftIndex.column();
-
-        for(auto &index: selectIndexes)
-        {
-            if(index.row() < top)
-                top = index.row();
-            if(index.column() < left)
-                left = index.column();
-            int tempWidth = index.column() - left+1;
-            int tempHeight = index.row() - top+1;
-            if(tempWidth > width)
-                width = tempWidth;
-            if(tempHeight > height)
-                height = tempHeight;
-        }
-
-        qDebug () << top<<left<<width<<height;
-        m_model->merge(top,left,width,height);
+        auto area = selectedRect(ui->tableView->selectionModel()->selection());
+        if(area.isEmpty())
+            return;
+        qDebug () << area.top()<<area.left()<<area.width()<<area.height();
+        m_model->merge(area.top(),area.left(),area.width(),area.height());
         // ui->tableView->setSpan(top,left,height,width);
     });
 
     connect(removeColAction,&QAction::triggered,this,[this]{
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        QSet<int> temp;
-        for(auto &index: selectIndexes)
-        {
-            //remove selectCols
-            auto col = index.column();
-            temp.insert(col);
-        }
-
-        for(auto col:temp)
-        {
-            m_model->removeColumn_(col);
-        }
+        m_model->removeColumnRanges_(selectedRuns(ui->tableView->selectionModel()->selection(),Qt::Horizontal));
     });
 
     connect(insertColFrontAction,&QAction::triggered,this,[this]{
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        QSet<int> temp;
-        for(auto &index: selectIndexes)
-        {
-            temp.insert(index.column());
-        }
-
-        auto minimum = std::min_element(temp.begin(),temp.end());
-        if(minimum != temp.end())
-        {
-            m_model->insertColumns_(*minimum,temp.size());
-        }
+        m_model->insertColumnRanges_(selectedRuns(ui->tableView->selectionModel()->selection(),Qt::Horizontal));
     });
 
     connect(insertColBackAction,&QAction::triggered,this,[this]{
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        QSet<int> temp;
-        for(auto &index: selectIndexes)
-        {
-            temp.insert(index.column());
-        }
-
-        auto maximum = std::max_element(temp.begin(),temp.end());
-        if(maximum != temp.end())
-        {
-            m_model->insertColumns_(*maximum+1,temp.size());
-        }
+        m_model->insertColumnRanges_(selectedRuns(ui->tableView->selectionModel()->selection(),Qt::Horizontal),true);
     });
 
     connect(removeRowAction,&QAction::triggered,this,[this]()
     {
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        QSet<int> temp;
-        for(auto &index: selectIndexes)
-        {
-            //remove selectRows
-            auto row = index.row();
-            temp.insert(row);
-        }
-
-        for(auto row:temp)
-        {
-            m_model->removeRow_(row);
-        }
+        m_model->removeRowRanges_(selectedRuns(ui->tableView->selectionModel()->selection(),Qt::Vertical));
     });
 
     connect(insertRowFrontAction,&QAction::triggered,this,[this](){
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        QSet<int> temp;
-        for(auto &index: selectIndexes)
-        {
-            temp.insert(index.row());
-        }
-        auto minimum = std::min_element(temp.begin(),temp.end());
-        if(minimum != temp.end())
-        {
-            m_model->insertRows_(*minimum,temp.size());
-        }
+        m_model->insertRowRanges_(selectedRuns(ui->tableView->selectionModel()->selection(),Qt::Vertical));
     });
 
     connect(insertRowBackAction,&QAction::triggered,this,[this](){
-        auto selectIndexes = ui->tableView->selectionModel()->selectedIndexes();
-        QSet<int> temp;
-        for(auto &index: selectIndexes)
-        {
-            temp.insert(index.row());
-        }
-        auto maxmimum = std::max_element(temp.begin(),temp.end());
-        if(maxmimum != temp.end())
-        {
-            m_model->insertRows_(*maxmimum+1,temp.size());
-        }
+        m_model->insertRowRanges_(selectedRuns(ui->tableView->selectionModel()->selection(),Qt::Vertical),true);
     });
 
 }
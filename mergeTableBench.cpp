@@ -0,0 +1,566 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QtTest>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include "mergeModel.h"
+#include "cellKernels.h"
+#include "tableIO.h"
+#include "sqliteBackend.h"
+
+#define BENCHSEED 20240601      //same tables on every run and machine
+#define BENCHBLOCK 8            //a merged cell is placed inside one of these squares
+#define BENCHOPS 20             //edits timed together by the structural benchmarks
+#define BENCHLOOKUPS 1000       //random positions read by cellAt
+#define BENCHWINDOWS 16         //viewports swept by data and span
+#define BENCHVIEWROWS 40
+#define BENCHVIEWCOLS 20
+
+// Benchmarks of the model over generated tables of 1k to 1M cells.
+// Run with -json <file> to also write the results as JSON, e.g.
+//   mergeTable_bench -json results.json
+// Other arguments are passed on to QtTest (a function name, -tickcounter, ...).
+
+//a table every cell of which holds a value; a quarter of the BENCHBLOCK
+//squares hold one merged cell of random size
+struct BenchTable {
+    TableState state;
+    QList<QRect> merges;    //x = col, y = row
+};
+
+//mostly values repeated all over the table, as entered by hand, some unique
+static QString benchValue(QRandomGenerator &rng, int row, int col)
+{
+    static const char *words[] = {"Cell", "open", "closed", "n/a", "total", "0", "1", "yes", "no", "pending"};
+    if(rng.bounded(4) == 0)
+        return QString("r%1c%2").arg(row).arg(col);
+    return QString::fromLatin1(words[rng.bounded(int(std::size(words)))]);
+}
+
+static BenchTable generateTable(int rows, int cols)
+{
+    QRandomGenerator rng(BENCHSEED+rows*31+cols);
+    BenchTable table;
+    std::vector<int> owner(size_t(rows)*cols,-1);
+    for(int top = 0; top < rows; top += BENCHBLOCK)
+    {
+        for(int left = 0; left < cols; left += BENCHBLOCK)
+        {
+            if(rng.bounded(4) != 0)
+                continue;
+            int height = qMin(2+rng.bounded(BENCHBLOCK-1),rows-top);
+            int width = qMin(2+rng.bounded(BENCHBLOCK-1),cols-left);
+            QRect merge(left+rng.bounded(qMin(BENCHBLOCK,cols-left)-width+1),
+                        top+rng.bounded(qMin(BENCHBLOCK,rows-top)-height+1),width,height);
+            if(merge.width() < 2 && merge.height() < 2)
+                continue;
+            for(int r = merge.top(); r <= merge.bottom(); r++)
+                std::fill_n(owner.begin()+size_t(r)*cols+merge.left(),width,int(table.merges.size()));
+            table.merges.append(merge);
+        }
+    }
+
+    auto &state = table.state;
+    state.rowMap.reset(rows);
+    state.colMap.reset(cols);
+    for(int r = 0; r < rows; r++)
+    {
+        for(int c = 0; c < cols; c++)
+        {
+            auto i = owner[size_t(r)*cols+c];
+            if(i >= 0 && table.merges[i].topLeft() != QPoint(c,r))
+                continue;
+            Cell cell;
+            cell.row = r;
+            cell.col = c;
+            if(i >= 0)
+            {
+                cell.rowSpan = table.merges[i].height();
+                cell.colSpan = table.merges[i].width();
+            }
+            cell.val = benchValue(rng,r,c);
+            state.cells.append(cell);
+        }
+    }
+    return table;
+}
+
+class mergeTableBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void data_data() { sizes(); }
+    void data();
+    void span_data() { sizes(); }
+    void span();
+    void cellAt_data() { sizes(); }
+    void cellAt();
+
+    void insertRows_data() { sizes(); }
+    void insertRows();
+    void removeRows_data() { sizes(); }
+    void removeRows();
+    void insertColumns_data() { sizes(); }
+    void insertColumns();
+    void removeColumns_data() { sizes(); }
+    void removeColumns();
+    void merge_data() { sizes(); }
+    void merge();
+    void split_data() { sizes(); }
+    void split();
+    void undo_data() { sizes(); }
+    void undo();
+
+    void savetoDb_data() { sizes(); }
+    void savetoDb();
+    void savetoDbEdits_data() { sizes(); }
+    void savetoDbEdits();
+    void loadFromDb_data() { sizes(); }
+    void loadFromDb();
+    void loadFromDbPaged_data() { sizes(); }
+    void loadFromDbPaged();
+    void savetoJson_data() { sizes(); }
+    void savetoJson();
+    void loadFromJson_data() { sizes(); }
+    void loadFromJson();
+    void savetoBinary_data() { sizes(); }
+    void savetoBinary();
+    void loadFromBinary_data() { sizes(); }
+    void loadFromBinary();
+
+    void maxEnd_data() { sizes(); }
+    void maxEnd();
+    void selectMerged_data() { sizes(); }
+    void selectMerged();
+    void selectAnchored_data() { sizes(); }
+    void selectAnchored();
+
+private:
+    void sizes();
+    const BenchTable &table();
+    std::unique_ptr<mergeModel> load();
+    QList<QPoint> positions(int count, int rows, int cols, quint32 seed) const;
+
+    QTemporaryDir m_dir;
+    QHash<QString,BenchTable> m_tables;     //by data tag, with their json beside them
+};
+
+void mergeTableBench::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    //the model keeps its database in the working directory
+    QDir::setCurrent(m_dir.path());
+    sqliteBackend::install();
+}
+
+void mergeTableBench::sizes()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<int>("cols");
+    QTest::newRow("1k") << 40 << 25;
+    QTest::newRow("10k") << 125 << 80;
+    QTest::newRow("100k") << 400 << 250;
+    QTest::newRow("1M") << 1250 << 800;
+}
+
+//generated once per size, then loaded from its json by every benchmark
+const BenchTable &mergeTableBench::table()
+{
+    QString tag = QTest::currentDataTag();
+    auto it = m_tables.find(tag);
+    if(it == m_tables.end())
+    {
+        QFETCH(int,rows);
+        QFETCH(int,cols);
+        it = m_tables.insert(tag,generateTable(rows,cols));
+        writeJson(m_dir.filePath(tag+".json"),it->state);
+    }
+    return *it;
+}
+
+std::unique_ptr<mergeModel> mergeTableBench::load()
+{
+    table();
+    std::unique_ptr<mergeModel> model(new mergeModel(nullptr));
+    model->loadFromJson(m_dir.filePath(QString(QTest::currentDataTag())+".json"));
+    return model;
+}
+
+QList<QPoint> mergeTableBench::positions(int count, int rows, int cols, quint32 seed) const
+{
+    QRandomGenerator rng(seed);
+    QList<QPoint> points;
+    for(int i = 0; i < count; i++)
+        points.append(QPoint(rng.bounded(cols),rng.bounded(rows)));
+    return points;
+}
+
+void mergeTableBench::data()
+{
+    auto model = load();
+    int rows = model->rowCount();
+    int cols = model->columnCount();
+    qint64 chars = 0;
+    QBENCHMARK
+    {
+        //viewports down the diagonal, as scrolling through the table paints them
+        for(int k = 0; k < BENCHWINDOWS; k++)
+        {
+            int top = qMax(rows-BENCHVIEWROWS,0)*k/(BENCHWINDOWS-1);
+            int left = qMax(cols-BENCHVIEWCOLS,0)*k/(BENCHWINDOWS-1);
+            for(int r = top; r < qMin(top+BENCHVIEWROWS,rows); r++)
+                for(int c = left; c < qMin(left+BENCHVIEWCOLS,cols); c++)
+                    chars += model->data(model->index(r,c)).toString().size();
+        }
+    }
+    QVERIFY(chars > 0);
+}
+
+void mergeTableBench::span()
+{
+    auto model = load();
+    int rows = model->rowCount();
+    int cols = model->columnCount();
+    int spanned = 0;
+    QBENCHMARK
+    {
+        for(int k = 0; k < BENCHWINDOWS; k++)
+        {
+            int top = qMax(rows-BENCHVIEWROWS,0)*k/(BENCHWINDOWS-1);
+            int left = qMax(cols-BENCHVIEWCOLS,0)*k/(BENCHWINDOWS-1);
+            for(int r = top; r < qMin(top+BENCHVIEWROWS,rows); r++)
+                for(int c = left; c < qMin(left+BENCHVIEWCOLS,cols); c++)
+                    spanned += model->span(model->index(r,c)) != QSize(1,1);
+        }
+    }
+    QVERIFY(spanned > 0);
+}
+
+void mergeTableBench::cellAt()
+{
+    auto model = load();
+    auto points = positions(BENCHLOOKUPS,model->rowCount(),model->columnCount(),BENCHSEED);
+    int found = 0;
+    QBENCHMARK
+    {
+        for(auto &&point : points)
+            found += model->cellAt(point.y(),point.x()).has_value();
+    }
+    QVERIFY(found > 0);
+}
+
+//structural edits change the table, so each is timed once over BENCHOPS of
+//them, until the last one is in the table
+void mergeTableBench::insertRows()
+{
+    auto model = load();
+    auto points = positions(BENCHOPS,model->rowCount(),model->columnCount(),BENCHSEED+1);
+    QBENCHMARK_ONCE
+    {
+        for(auto &&point : points)
+            model->insertRows_(point.y(),1);
+        model->waitForEdits();
+    }
+}
+
+void mergeTableBench::removeRows()
+{
+    auto model = load();
+    auto points = positions(BENCHOPS,model->rowCount()-BENCHOPS,model->columnCount(),BENCHSEED+2);
+    QBENCHMARK_ONCE
+    {
+        for(auto &&point : points)
+            model->removeRows_(point.y(),1);
+        model->waitForEdits();
+    }
+}
+
+void mergeTableBench::insertColumns()
+{
+    auto model = load();
+    auto points = positions(BENCHOPS,model->rowCount(),model->columnCount(),BENCHSEED+3);
+    QBENCHMARK_ONCE
+    {
+        for(auto &&point : points)
+            model->insertColumns_(point.x(),1);
+        model->waitForEdits();
+    }
+}
+
+void mergeTableBench::removeColumns()
+{
+    auto model = load();
+    auto points = positions(BENCHOPS,model->rowCount(),model->columnCount()-BENCHOPS,BENCHSEED+4);
+    QBENCHMARK_ONCE
+    {
+        for(auto &&point : points)
+            model->removeColumns_(point.x(),1);
+        model->waitForEdits();
+    }
+}
+
+//random 4x4 areas, some of them growing over the generated merged cells
+void mergeTableBench::merge()
+{
+    auto model = load();
+    auto points = positions(BENCHOPS,model->rowCount()-4,model->columnCount()-4,BENCHSEED+5);
+    QBENCHMARK_ONCE
+    {
+        for(auto &&point : points)
+            model->merge(point.y(),point.x(),4,4);
+        model->waitForEdits();
+    }
+}
+
+void mergeTableBench::split()
+{
+    auto merges = table().merges.mid(0,BENCHOPS);
+    auto model = load();
+    QBENCHMARK_ONCE
+    {
+        for(auto &&merge : merges)
+            model->split(merge.top(),merge.left());
+        model->waitForEdits();
+    }
+}
+
+void mergeTableBench::undo()
+{
+    auto model = load();
+    auto points = positions(BENCHOPS,model->rowCount(),model->columnCount(),BENCHSEED+6);
+    for(auto &&point : points)
+        model->insertRows_(point.y(),1);
+    model->waitForEdits();
+    QBENCHMARK_ONCE
+    {
+        for(int i = 0; i < BENCHOPS; i++)
+            model->undo();
+    }
+}
+
+//a full save: the table was read from a file
+void mergeTableBench::savetoDb()
+{
+    auto model = load();
+    auto name = QString("bench_%1").arg(QTest::currentDataTag());
+    model->initTable(name);
+    QBENCHMARK_ONCE
+    {
+        QVERIFY(model->savetoDb(name));
+    }
+}
+
+//saves as an editing session makes them, a few cells each
+void mergeTableBench::savetoDbEdits()
+{
+    auto model = load();
+    auto name = QString("bench_%1").arg(QTest::currentDataTag());
+    model->initTable(name);
+    QVERIFY(model->savetoDb(name));
+    auto points = positions(BENCHOPS,model->rowCount(),model->columnCount(),BENCHSEED+7);
+    QBENCHMARK_ONCE
+    {
+        for(auto &&point : points)
+        {
+            model->setData(model->index(point.y(),point.x()),QString("edit"));
+            QVERIFY(model->savetoDb(name));
+        }
+    }
+}
+
+void mergeTableBench::loadFromDb()
+{
+    auto model = load();
+    auto name = QString("bench_%1").arg(QTest::currentDataTag());
+    model->initTable(name);
+    QVERIFY(model->savetoDb(name));
+    QBENCHMARK
+    {
+        QVERIFY(model->loadFromDb(name));
+    }
+}
+
+//what a view waits for before the first rows show
+void mergeTableBench::loadFromDbPaged()
+{
+    auto model = load();
+    auto name = QString("bench_%1").arg(QTest::currentDataTag());
+    model->initTable(name);
+    QVERIFY(model->savetoDb(name));
+    QBENCHMARK
+    {
+        QVERIFY(model->loadFromDbPaged(name));
+    }
+}
+
+void mergeTableBench::savetoJson()
+{
+    auto model = load();
+    auto fileName = m_dir.filePath(QString("save_%1.json").arg(QTest::currentDataTag()));
+    QBENCHMARK
+    {
+        model->savetoJson(fileName);
+    }
+}
+
+void mergeTableBench::loadFromJson()
+{
+    table();
+    mergeModel model(nullptr);
+    auto fileName = m_dir.filePath(QString(QTest::currentDataTag())+".json");
+    QBENCHMARK
+    {
+        model.loadFromJson(fileName);
+    }
+    QVERIFY(model.rowCount() > 0);
+}
+
+void mergeTableBench::savetoBinary()
+{
+    auto model = load();
+    auto fileName = m_dir.filePath(QString("save_%1.bin").arg(QTest::currentDataTag()));
+    QBENCHMARK
+    {
+        QVERIFY(model->savetoBinary(fileName));
+    }
+}
+
+void mergeTableBench::loadFromBinary()
+{
+    auto model = load();
+    auto fileName = m_dir.filePath(QString("%1.bin").arg(QTest::currentDataTag()));
+    QVERIFY(model->savetoBinary(fileName));
+    QBENCHMARK
+    {
+        QVERIFY(model->loadFromBinary(fileName));
+    }
+}
+
+void mergeTableBench::maxEnd()
+{
+    const auto &cells = table().state.cells;
+    int end = 0;
+    QBENCHMARK
+    {
+        end = ::maxEnd(cells.rows(),cells.rowSpans(),cells.size());
+    }
+    QCOMPARE(end,table().state.rowMap.size());
+}
+
+void mergeTableBench::selectMerged()
+{
+    const auto &cells = table().state.cells;
+    QList<int> out;
+    QBENCHMARK
+    {
+        out.clear();
+        ::selectMerged(cells.rowSpans(),cells.colSpans(),cells.size(),out);
+    }
+    QCOMPARE(out.size(),table().merges.size());
+}
+
+//the middle quarter of the table
+void mergeTableBench::selectAnchored()
+{
+    const auto &state = table().state;
+    int top = state.rowMap.size()/4;
+    int left = state.colMap.size()/4;
+    QList<int> out;
+    QBENCHMARK
+    {
+        out.clear();
+        ::selectAnchored(state.cells.rows(),state.cells.cols(),state.cells.size(),
+                         top,left,top*3,left*3,out);
+    }
+    QVERIFY(!out.isEmpty());
+}
+
+//the BenchmarkResult elements of a QtTest xml log, as a json document
+static bool exportJson(const QString &xmlName, const QString &jsonName)
+{
+    QFile xml(xmlName);
+    if(!xml.open(QIODevice::ReadOnly))
+        return false;
+    QJsonArray results;
+    QString function;
+    QXmlStreamReader reader(&xml);
+    while(!reader.atEnd())
+    {
+        if(reader.readNext() != QXmlStreamReader::StartElement)
+            continue;
+        auto attrs = reader.attributes();
+        if(reader.name() == QLatin1String("TestFunction"))
+            function = attrs.value("name").toString();
+        else if(reader.name() == QLatin1String("BenchmarkResult"))
+            results.append(QJsonObject{
+                {"name", function},
+                {"tag", attrs.value("tag").toString()},
+                {"metric", attrs.value("metric").toString()},
+                {"value", attrs.value("value").toDouble()},
+                {"iterations", attrs.value("iterations").toInt()},
+            });
+    }
+    if(reader.hasError())
+    {
+        qWarning() << "Failed to read benchmark log:" << reader.errorString();
+        return false;
+    }
+
+    QJsonObject root{
+        {"date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+        {"qt", QString(qVersion())},
+        {"cpu", QSysInfo::currentCpuArchitecture()},
+        {"os", QSysInfo::prettyProductName()},
+        {"results", results},
+    };
+    QFile out(jsonName);
+    if(!out.open(QIODevice::WriteOnly))
+        return false;
+    return out.write(QJsonDocument(root).toJson()) >= 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc,argv);
+    //the model logs every cell it loads, under mergetable.*
+    QLoggingCategory::setFilterRules("mergetable.*.debug=false");
+
+    auto args = app.arguments();
+    QString jsonName;
+    auto at = args.indexOf("-json");
+    if(at > 0 && at+1 < args.size())
+    {
+        jsonName = QFileInfo(args.at(at+1)).absoluteFilePath();
+        args.remove(at,2);
+    }
+    QTemporaryDir logDir;
+    auto xmlName = logDir.filePath("bench.xml");
+    if(!jsonName.isEmpty())
+        args << "-o" << xmlName+",xml" << "-o" << "-,txt";
+
+    mergeTableBench bench;
+    int status = QTest::qExec(&bench,args);
+    if(!jsonName.isEmpty() && !exportJson(xmlName,jsonName))
+    {
+        qWarning() << "Failed to write" << jsonName;
+        return status ? status : 1;
+    }
+    return status;
+}
+
+#include "mergeTableBench.moc"
@@ -0,0 +1,174 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QTextStream>
+#include "mergeModel.h"
+#include "tableBackend.h"
+#include "sqliteBackend.h"
+#include "tableTrace.h"
+
+// Applies a script of edits to a table file without a display:
+//   mergetable-cli [-o out] [--sparse] table [script]
+// The table is read and written through tableBackend::forFile, so .json,
+// .mtab and SQLite databases ("file.db:table") all work. The script is read
+// from stdin when not given, one edit per line, '#' starting a comment:
+//   insertRows ROW COUNT        removeRows ROW COUNT
+//   insertColumns COL COUNT     removeColumns COL COUNT
+//   merge TOP LEFT WIDTH HEIGHT splitArea TOP LEFT WIDTH HEIGHT
+//   split ROW COL               set ROW COL VALUE...
+// The whole script runs as one edit group, on this thread.
+
+//arguments of an edit: count ints, and for 'set' the rest of the line
+struct ScriptEdit {
+    QString name;
+    QList<int> args;
+    QString val;
+};
+
+static const QHash<QString,int> &editArgs()
+{
+    static const QHash<QString,int> args{
+        {"insertRows", 2}, {"removeRows", 2}, {"insertColumns", 2}, {"removeColumns", 2},
+        {"merge", 4}, {"splitArea", 4}, {"split", 2}, {"set", 2},
+    };
+    return args;
+}
+
+static bool parseEdit(const QString &line, ScriptEdit &edit, QString &error)
+{
+    auto words = line.simplified().split(' ');
+    edit.name = words.value(0);
+    if(!editArgs().contains(edit.name))
+    {
+        error = QString("unknown edit '%1'").arg(edit.name);
+        return false;
+    }
+    int count = editArgs().value(edit.name);
+    if(words.size() < count+1 || (edit.name != "set" && words.size() > count+1))
+    {
+        error = QString("%1 takes %2 numbers").arg(edit.name).arg(count);
+        return false;
+    }
+    for(int i = 1; i <= count; i++)
+    {
+        bool ok = false;
+        edit.args.append(words[i].toInt(&ok));
+        if(!ok)
+        {
+            error = QString("'%1' is not a number").arg(words[i]);
+            return false;
+        }
+    }
+    //the value keeps its own spacing
+    if(edit.name == "set")
+        edit.val = line.trimmed().section(' ',count+1,-1,QString::SectionSkipEmpty);
+    return true;
+}
+
+static void applyEdit(mergeModel &model, const ScriptEdit &edit)
+{
+    const auto &a = edit.args;
+    if(edit.name == "insertRows")
+        model.insertRows_(a[0],a[1]);
+    else if(edit.name == "removeRows")
+        model.removeRows_(a[0],a[1]);
+    else if(edit.name == "insertColumns")
+        model.insertColumns_(a[0],a[1]);
+    else if(edit.name == "removeColumns")
+        model.removeColumns_(a[0],a[1]);
+    else if(edit.name == "merge")
+        model.merge(a[0],a[1],a[2],a[3]);
+    else if(edit.name == "splitArea")
+        model.splitArea(a[0],a[1],a[2],a[3]);
+    else if(edit.name == "split")
+        model.split(a[0],a[1]);
+    else if(edit.name == "set")
+        model.setValues(a[0],a[1],QList<QStringList>{QStringList{edit.val}});
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc,argv);
+    QCoreApplication::setApplicationName("mergetable-cli");
+    tableTrace::startFromEnvironment();
+    sqliteBackend::install();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Apply a script of edits to a merge table file.");
+    parser.addHelpOption();
+    QCommandLineOption outOption({"o","output"},"Write the result to <file> instead of the table.","file");
+    QCommandLineOption sparseOption("sparse","Store the table sparse.");
+    QCommandLineOption verboseOption({"v","verbose"},"Keep the model's debug output.");
+    parser.addOptions({outOption,sparseOption,verboseOption});
+    parser.addPositionalArgument("table","Table file to edit.");
+    parser.addPositionalArgument("script","Edits to apply, stdin when left out.","[script]");
+    parser.process(app);
+
+    QTextStream err(stderr);
+    auto args = parser.positionalArguments();
+    if(args.isEmpty() || args.size() > 2)
+        parser.showHelp(1);
+    //QT_LOGGING_RULES still wins, e.g. for mergetable.dump
+    if(!parser.isSet(verboseOption))
+        QLoggingCategory::setFilterRules("mergetable.*.debug=false");
+
+    //parsed in full first, a bad line leaves the table alone
+    QFile script(args.value(1));
+    bool opened = args.size() > 1 ? script.open(QIODevice::ReadOnly | QIODevice::Text)
+                                  : script.open(stdin,QIODevice::ReadOnly | QIODevice::Text);
+    if(!opened)
+    {
+        err << "Couldn't open script: " << script.errorString() << Qt::endl;
+        return 1;
+    }
+    QList<ScriptEdit> edits;
+    QTextStream in(&script);
+    for(int lineNo = 1; !in.atEnd(); lineNo++)
+    {
+        auto line = in.readLine();
+        if(line.trimmed().isEmpty() || line.trimmed().startsWith('#'))
+            continue;
+        ScriptEdit edit;
+        QString error;
+        if(!parseEdit(line,edit,error))
+        {
+            err << "line " << lineNo << ": " << error << Qt::endl;
+            return 1;
+        }
+        edits.append(edit);
+    }
+
+    mergeModel model(nullptr);
+    auto input = tableBackend::forFile(args[0]);
+    QElapsedTimer timer;
+    timer.start();
+    if(!input || !model.load(*input))
+    {
+        err << "Couldn't read " << args[0] << Qt::endl;
+        return 1;
+    }
+    auto readMs = timer.restart();
+    if(parser.isSet(sparseOption))
+        model.setSparse(true);
+
+    //grouped, the edits skip the engine and announce their values once
+    model.beginEditGroup();
+    for(auto &&edit : edits)
+        applyEdit(model,edit);
+    model.endEditGroup();
+    auto editMs = timer.restart();
+
+    auto outName = parser.isSet(outOption) ? parser.value(outOption) : args[0];
+    auto output = tableBackend::forFile(outName);
+    if(!output || !model.save(*output))
+    {
+        err << "Couldn't write " << outName << Qt::endl;
+        return 1;
+    }
+    QTextStream(stdout) << edits.size() << " edits on " << model.rowCount() << "x" << model.columnCount()
+                        << ": read " << readMs << " ms, edited " << editMs << " ms, wrote "
+                        << timer.elapsed() << " ms" << Qt::endl;
+    return 0;
+}
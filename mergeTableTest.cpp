@@ -0,0 +1,850 @@
+#include <QDir>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtTest>
+#include <vector>
+#include <cmath>
+#include "mergeModel.h"
+#include "tableIO.h"
+#include "tableFile.h"
+#include "sqliteBackend.h"
+
+#define TESTSEED 20240601   //same edits on every run
+#define TESTRUNS 50         //random edit sequences checked against the oracle
+#define TESTSTEPS 60        //edits in each
+#define TESTMAXSIZE 12      //rows or columns the random edits grow the table to
+#define TESTENGINERUNS 2    //random edit sequences on a table big enough for the engine
+#define TESTENGINESTEPS 20
+#define TESTROUNDTRIPS 10   //random edit sequences saved and read back
+
+// Unit tests of the model: random edits against a brute force copy of the
+// table, and the save, load and undo paths around it. Run mergeTable_test,
+// or ctest from the build directory.
+
+//the table as a plain list of cells at logical positions, each edit a scan
+//over all of them; undo keeps a copy of the whole list
+class tableOracle
+{
+public:
+    struct Cell {
+        QString val;
+        int row = 0;
+        int col = 0;
+        int rowSpan = 1;
+        int colSpan = 1;
+    };
+
+    int rows() const
+    {
+        int last = 0;
+        for(auto &&cell : m_cells)
+            last = qMax(last,cell.row+cell.rowSpan-1);
+        return last+1;
+    }
+    int cols() const
+    {
+        int last = 0;
+        for(auto &&cell : m_cells)
+            last = qMax(last,cell.col+cell.colSpan-1);
+        return last+1;
+    }
+    const Cell *at(int row, int col) const
+    {
+        for(auto &&cell : m_cells)
+            if(row >= cell.row && row < cell.row+cell.rowSpan && col >= cell.col && col < cell.col+cell.colSpan)
+                return &cell;
+        return nullptr;
+    }
+    Cell *anchor(int row, int col)
+    {
+        for(auto &&cell : m_cells)
+            if(cell.row == row && cell.col == col)
+                return &cell;
+        return nullptr;
+    }
+    const std::vector<Cell> &cells() const { return m_cells; }
+
+    void setValue(int row, int col, const QString &val)
+    {
+        save();
+        anchor(row,col)->val = val;
+    }
+    //a merged cell the new lines cross grows, others are copied from the line before
+    void insertRows(int row, int count)
+    {
+        save();
+        QList<QPair<int,int>> added;    //col, colSpan
+        QList<Cell*> grown;
+        for(int col = 0; col < cols();)
+        {
+            auto cell = crossing(true,row,col);
+            if(cell)
+            {
+                grown.append(cell);
+                col += cell->colSpan;
+                continue;
+            }
+            auto above = anchor(row-1,col);
+            int span = above ? above->colSpan : 1;
+            added.append({col,span});
+            col += span;
+        }
+        for(auto cell : grown)
+            cell->rowSpan += count;
+        for(auto &&cell : m_cells)
+            if(cell.row >= row)
+                cell.row += count;
+        for(int r = row; r < row+count; r++)
+            for(auto [col,span] : added)
+                m_cells.push_back({CELLDEFAULT,r,col,1,span});
+    }
+    void insertColumns(int col, int count)
+    {
+        save();
+        QList<QPair<int,int>> added;    //row, rowSpan
+        QList<Cell*> grown;
+        for(int row = 0; row < rows();)
+        {
+            auto cell = crossing(false,col,row);
+            if(cell)
+            {
+                grown.append(cell);
+                row += cell->rowSpan;
+                continue;
+            }
+            auto left = anchor(row,col-1);
+            int span = left ? left->rowSpan : 1;
+            added.append({row,span});
+            row += span;
+        }
+        for(auto cell : grown)
+            cell->colSpan += count;
+        for(auto &&cell : m_cells)
+            if(cell.col >= col)
+                cell.col += count;
+        for(int c = col; c < col+count; c++)
+            for(auto [row,span] : added)
+                m_cells.push_back({CELLDEFAULT,row,c,span,1});
+    }
+    //a merged cell over the line shrinks, any other cell on it goes
+    void removeRow(int row)
+    {
+        save();
+        std::vector<Cell> kept;
+        for(auto cell : m_cells)
+        {
+            if(cell.row <= row && cell.row+cell.rowSpan > row)
+            {
+                if(cell.rowSpan == 1)
+                    continue;
+                cell.rowSpan--;
+            }
+            else if(cell.row > row)
+                cell.row--;
+            kept.push_back(cell);
+        }
+        m_cells = kept;
+    }
+    void removeColumn(int col)
+    {
+        save();
+        std::vector<Cell> kept;
+        for(auto cell : m_cells)
+        {
+            if(cell.col <= col && cell.col+cell.colSpan > col)
+            {
+                if(cell.colSpan == 1)
+                    continue;
+                cell.colSpan--;
+            }
+            else if(cell.col > col)
+                cell.col--;
+            kept.push_back(cell);
+        }
+        m_cells = kept;
+    }
+    //the top left cell takes the whole area and keeps its value
+    void merge(int top, int left, int width, int height)
+    {
+        auto merged = *anchor(top,left);
+        save();
+        std::vector<Cell> kept;
+        for(auto &&cell : m_cells)
+            if(cell.row < top || cell.row >= top+height || cell.col < left || cell.col >= left+width)
+                kept.push_back(cell);
+        merged.rowSpan = height;
+        merged.colSpan = width;
+        kept.push_back(merged);
+        m_cells = kept;
+    }
+    //the area goes back to default cells
+    void split(int row, int col)
+    {
+        auto merged = *anchor(row,col);
+        save();
+        std::vector<Cell> kept;
+        for(auto &&cell : m_cells)
+            if(cell.row != row || cell.col != col)
+                kept.push_back(cell);
+        for(int r = merged.row; r < merged.row+merged.rowSpan; r++)
+            for(int c = merged.col; c < merged.col+merged.colSpan; c++)
+                kept.push_back({CELLDEFAULT,r,c,1,1});
+        m_cells = kept;
+    }
+    //every merged cell reaching into any of the areas, in one undo step
+    void splitAreas(const QList<QRect> &areas)
+    {
+        save();
+        std::vector<Cell> kept;
+        for(auto &&cell : m_cells)
+        {
+            QRect rect(cell.col,cell.row,cell.colSpan,cell.rowSpan);
+            bool hit = (cell.rowSpan > 1 || cell.colSpan > 1) &&
+                       std::any_of(areas.cbegin(),areas.cend(),[&rect](const QRect &area){ return area.intersects(rect); });
+            if(!hit)
+            {
+                kept.push_back(cell);
+                continue;
+            }
+            for(int r = cell.row; r < cell.row+cell.rowSpan; r++)
+                for(int c = cell.col; c < cell.col+cell.colSpan; c++)
+                    kept.push_back({CELLDEFAULT,r,c,1,1});
+        }
+        m_cells = kept;
+    }
+    void undo()
+    {
+        if(m_undo.empty())
+            return;
+        m_redo.push_back(m_cells);
+        m_cells = m_undo.back();
+        m_undo.pop_back();
+    }
+    void redo()
+    {
+        if(m_redo.empty())
+            return;
+        m_undo.push_back(m_cells);
+        m_cells = m_redo.back();
+        m_redo.pop_back();
+    }
+
+private:
+    void save()
+    {
+        m_undo.push_back(m_cells);
+        m_redo.clear();
+    }
+    //the merged cell a new line at pos would cut through, at line position at
+    Cell *crossing(bool rows, int pos, int at)
+    {
+        for(auto &&cell : m_cells)
+        {
+            int first = rows ? cell.row : cell.col;
+            int span = rows ? cell.rowSpan : cell.colSpan;
+            if((rows ? cell.col : cell.row) == at && first < pos && first+span > pos)
+                return &cell;
+        }
+        return nullptr;
+    }
+
+    std::vector<Cell> m_cells;
+    std::vector<std::vector<Cell>> m_undo;
+    std::vector<std::vector<Cell>> m_redo;
+};
+
+//every position as "row,col value widthxheight", the span only for an anchor
+static QStringList tableText(const mergeModel &model)
+{
+    QStringList text;
+    for(int row = 0; row < model.rowCount(); row++)
+    {
+        for(int col = 0; col < model.columnCount(); col++)
+        {
+            auto index = model.index(row,col);
+            auto span = model.span(index);
+            text.append(QString("%1,%2 %3 %4x%5").arg(row).arg(col).arg(model.data(index).toString())
+                        .arg(span.width()).arg(span.height()));
+        }
+    }
+    return text;
+}
+
+static QStringList tableText(const tableOracle &oracle)
+{
+    //each cell paints the positions it covers, big tables included
+    int rows = oracle.rows(), cols = oracle.cols();
+    std::vector<const tableOracle::Cell*> grid(size_t(rows)*cols,nullptr);
+    for(auto &&cell : oracle.cells())
+        for(int r = cell.row; r < cell.row+cell.rowSpan; r++)
+            for(int c = cell.col; c < cell.col+cell.colSpan; c++)
+                grid[size_t(r)*cols+c] = &cell;
+    QStringList text;
+    for(int row = 0; row < rows; row++)
+    {
+        for(int col = 0; col < cols; col++)
+        {
+            auto cell = grid[size_t(row)*cols+col];
+            bool anchor = cell && cell->row == row && cell->col == col;
+            text.append(QString("%1,%2 %3 %4x%5").arg(row).arg(col).arg(cell ? cell->val : QString())
+                        .arg(anchor ? cell->colSpan : 1).arg(anchor ? cell->rowSpan : 1));
+        }
+    }
+    return text;
+}
+
+//a rows x cols table of distinct values with a few merged cells
+static void fillTable(mergeModel &model, int rows, int cols)
+{
+    model.insertRows_(0,1);
+    model.insertColumns_(1,cols-1);
+    model.insertRows_(1,rows-1);
+    for(int row = 0; row < rows; row++)
+        for(int col = 0; col < cols; col++)
+            model.setData(model.index(row,col),QString("r%1c%2").arg(row).arg(col));
+    model.merge(1,1,2,2);
+    model.merge(rows-1,0,3,1);
+}
+
+//one random insert, remove, merge, split, grouped split, value, undo or redo,
+//on both; steps gets its description
+static void randomEdit(QRandomGenerator &rng, tableOracle &oracle, mergeModel &model, int maxSize, QString &steps)
+{
+    int rows = oracle.rows();
+    int cols = oracle.cols();
+    switch(rng.bounded(10))
+    {
+    case 0:
+    {
+        int row = rng.bounded(rows+1), count = 1+rng.bounded(2);
+        if(rows+count > maxSize)
+            return;
+        steps += QString(" insertRows %1 %2").arg(row).arg(count);
+        oracle.insertRows(row,count);
+        model.insertRows_(row,count);
+        break;
+    }
+    case 1:
+    {
+        int col = rng.bounded(cols+1), count = 1+rng.bounded(2);
+        if(cols+count > maxSize)
+            return;
+        steps += QString(" insertColumns %1 %2").arg(col).arg(count);
+        oracle.insertColumns(col,count);
+        model.insertColumns_(col,count);
+        break;
+    }
+    case 2:
+    {
+        int row = rng.bounded(rows);
+        if(rows <= 2)
+            return;
+        steps += QString(" removeRow %1").arg(row);
+        oracle.removeRow(row);
+        model.removeRow_(row);
+        break;
+    }
+    case 3:
+    {
+        int col = rng.bounded(cols);
+        if(cols <= 2)
+            return;
+        steps += QString(" removeColumn %1").arg(col);
+        oracle.removeColumn(col);
+        model.removeColumn_(col);
+        break;
+    }
+    case 4:
+    {
+        //only areas no merged cell sticks out of, the model widens the others
+        int top = rng.bounded(rows), left = rng.bounded(cols);
+        int height = 1+rng.bounded(3), width = 1+rng.bounded(3);
+        if(top+height > rows || left+width > cols || (height == 1 && width == 1))
+            return;
+        bool inside = true;
+        for(auto &&cell : oracle.cells())
+        {
+            bool overlaps = cell.row < top+height && cell.row+cell.rowSpan > top &&
+                            cell.col < left+width && cell.col+cell.colSpan > left;
+            bool within = cell.row >= top && cell.row+cell.rowSpan <= top+height &&
+                          cell.col >= left && cell.col+cell.colSpan <= left+width;
+            if(overlaps && !within)
+                inside = false;
+        }
+        if(!inside)
+            return;
+        steps += QString(" merge %1 %2 %3 %4").arg(top).arg(left).arg(width).arg(height);
+        oracle.merge(top,left,width,height);
+        model.merge(top,left,width,height);
+        break;
+    }
+    case 5:
+    {
+        QList<QPoint> merged;
+        for(auto &&cell : oracle.cells())
+            if(cell.rowSpan > 1 || cell.colSpan > 1)
+                merged.append(QPoint(cell.col,cell.row));
+        if(merged.isEmpty())
+            return;
+        auto at = merged.at(rng.bounded(int(merged.size())));
+        steps += QString(" split %1 %2").arg(at.y()).arg(at.x());
+        oracle.split(at.y(),at.x());
+        model.split(at.y(),at.x());
+        break;
+    }
+    case 6:
+    {
+        int row = rng.bounded(rows), col = rng.bounded(cols);
+        if(!oracle.anchor(row,col))
+            return;
+        //the default too, which a sparse table drops
+        auto val = rng.bounded(4) == 0 ? QString(CELLDEFAULT) : QString("v%1").arg(rng.bounded(1000));
+        steps += QString(" set %1 %2").arg(row).arg(col);
+        oracle.setValue(row,col,val);
+        model.setData(model.index(row,col),val);
+        break;
+    }
+    case 7:
+        steps += " undo";
+        oracle.undo();
+        model.undo();
+        break;
+    case 8:
+        steps += " redo";
+        oracle.redo();
+        model.redo();
+        break;
+    case 9:
+    {
+        //two areas split in one group, the way the split action does a selection
+        QList<QRect> areas;
+        for(int i = 0; i < 2; i++)
+        {
+            int top = rng.bounded(rows), left = rng.bounded(cols);
+            areas.append(QRect(left,top,1+rng.bounded(4),1+rng.bounded(4)) & QRect(0,0,cols,rows));
+        }
+        bool any = false;
+        for(auto &&cell : oracle.cells())
+            for(auto &&area : areas)
+                any = any || ((cell.rowSpan > 1 || cell.colSpan > 1) && area.intersects(QRect(cell.col,cell.row,cell.colSpan,cell.rowSpan)));
+        if(!any)
+            return;
+        steps += QString(" splitAreas %1 %2 %3 %4, %5 %6 %7 %8").arg(areas[0].y()).arg(areas[0].x())
+                 .arg(areas[0].width()).arg(areas[0].height()).arg(areas[1].y()).arg(areas[1].x())
+                 .arg(areas[1].width()).arg(areas[1].height());
+        oracle.splitAreas(areas);
+        model.beginEditGroup();
+        for(auto &&area : areas)
+            model.splitArea(area.top(),area.left(),area.width(),area.height());
+        model.endEditGroup();
+        break;
+    }
+    }
+}
+
+class mergeTableTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void editsMatchOracle_data();
+    void editsMatchOracle();
+    void engineEditsMatchOracle();
+    void roundTripsMatchOracle();
+    void staleHandles();
+    void incrementalSave();
+    void malformedJson_data();
+    void malformedJson();
+    void corruptBinary();
+    void removeEverything();
+    void ingestProducers();
+    void undoSpill();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+void mergeTableTest::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    //the model keeps its database in the working directory
+    QDir::setCurrent(m_dir.path());
+    sqliteBackend::install();
+}
+
+void mergeTableTest::editsMatchOracle_data()
+{
+    QTest::addColumn<bool>("sparse");
+    QTest::newRow("dense") << false;
+    QTest::newRow("sparse") << true;
+}
+
+//random inserts, removes, merges, splits and values, each undone and redone
+//at random, with the whole table compared after every step
+void mergeTableTest::editsMatchOracle()
+{
+    QFETCH(bool,sparse);
+    for(int run = 0; run < TESTRUNS; run++)
+    {
+        QRandomGenerator rng(TESTSEED+run);
+        tableOracle oracle;
+        mergeModel model(nullptr);
+        //before any edit, switching clears the undo history
+        model.setSparse(sparse);
+        oracle.insertRows(0,1);
+        model.insertRows_(0,1);
+        oracle.insertColumns(1,5);
+        model.insertColumns_(1,5);
+        oracle.insertRows(1,5);
+        model.insertRows_(1,5);
+
+        QString steps;
+        for(int step = 0; step < TESTSTEPS; step++)
+        {
+            randomEdit(rng,oracle,model,TESTMAXSIZE,steps);
+            model.waitForEdits();
+            QVERIFY2(tableText(model) == tableText(oracle),qPrintable(QString("run %1:%2").arg(run).arg(steps)));
+        }
+    }
+}
+
+//the same on a table past ENGINECELLS, where structural edits, edit groups
+//and their undo and redo run on the engine and are compared once published
+void mergeTableTest::engineEditsMatchOracle()
+{
+    int side = int(std::sqrt(double(ENGINECELLS)))+1;
+    for(int run = 0; run < TESTENGINERUNS; run++)
+    {
+        QRandomGenerator rng(TESTSEED+run);
+        tableOracle oracle;
+        mergeModel model(nullptr);
+        oracle.insertRows(0,1);
+        model.insertRows_(0,1);
+        oracle.insertColumns(1,side-1);
+        model.insertColumns_(1,side-1);
+        oracle.insertRows(1,side-1);
+        model.insertRows_(1,side-1);
+        for(int i = 0; i < 20; i++)
+        {
+            int top = 3*i, left = 2*i;
+            oracle.merge(top,left,2,3);
+            model.merge(top,left,2,3);
+        }
+        model.waitForEdits();
+
+        QString steps;
+        for(int step = 0; step < TESTENGINESTEPS; step++)
+        {
+            randomEdit(rng,oracle,model,side+4,steps);
+            model.waitForEdits();
+            QVERIFY2(tableText(model) == tableText(oracle),qPrintable(QString("run %1:%2").arg(run).arg(steps)));
+        }
+    }
+}
+
+//random edits saved to a binary file and to the database, each read back
+//on its own and compared with the oracle; the database one paged in small bands
+void mergeTableTest::roundTripsMatchOracle()
+{
+    for(int run = 0; run < TESTROUNDTRIPS; run++)
+    {
+        QRandomGenerator rng(TESTSEED+run);
+        tableOracle oracle;
+        mergeModel model(nullptr);
+        model.setSparse(run % 2 == 1);
+        oracle.insertRows(0,1);
+        model.insertRows_(0,1);
+        oracle.insertColumns(1,5);
+        model.insertColumns_(1,5);
+        oracle.insertRows(1,5);
+        model.insertRows_(1,5);
+        QString steps;
+        for(int step = 0; step < TESTSTEPS; step++)
+            randomEdit(rng,oracle,model,TESTMAXSIZE,steps);
+        model.waitForEdits();
+        auto expected = tableText(oracle);
+        QVERIFY2(tableText(model) == expected,qPrintable(QString("run %1:%2").arg(run).arg(steps)));
+
+        QVERIFY(model.savetoBinary(m_dir.filePath("roundtrip.mtab")));
+        mergeModel binary(nullptr);
+        QVERIFY(binary.loadFromBinary(m_dir.filePath("roundtrip.mtab")));
+        QVERIFY2(tableText(binary) == expected,qPrintable(QString("binary, run %1:%2").arg(run).arg(steps)));
+
+        //saves only go to an existing table
+        model.initTable("roundtrip");
+        QVERIFY(model.savetoDb("roundtrip"));
+        mergeModel paged(nullptr);
+        QVERIFY(paged.loadFromDbPaged("roundtrip",2));
+        while(paged.canFetchMore(QModelIndex()))
+            paged.fetchMore(QModelIndex());
+        QVERIFY2(tableText(paged) == expected,qPrintable(QString("paged, run %1:%2").arg(run).arg(steps)));
+    }
+}
+
+//a handle finds its cell wherever edits move it, and nothing once the cell
+//is removed, even when a new cell takes its slot or an undo brings it back
+void mergeTableTest::staleHandles()
+{
+    mergeModel model(nullptr);
+    fillTable(model,6,6);
+    auto removed = model.handleAt(2,3);
+    auto moved = model.handleAt(4,4);
+    QVERIFY(!removed.isNull());
+    QCOMPARE(QString(model.find(removed)->val),QString("r2c3"));
+
+    model.removeRow_(2);
+    model.waitForEdits();
+    QVERIFY(!model.find(removed));
+    QVERIFY(model.cellRect(removed).isEmpty());
+    QCOMPARE(model.cellRect(moved),QRect(4,3,1,1));
+    QCOMPARE(QString(model.find(moved)->val),QString("r4c4"));
+
+    //the new row's cells reuse the freed slots under new generations
+    model.insertRows_(2,1);
+    model.waitForEdits();
+    bool reused = false;
+    for(int col = 0; col < model.columnCount(); col++)
+    {
+        auto handle = model.handleAt(2,col);
+        reused = reused || handle.slot == removed.slot;
+        QVERIFY(handle != removed);
+    }
+    QVERIFY(reused);
+    QVERIFY(!model.find(removed));
+    QCOMPARE(model.cellRect(moved),QRect(4,4,1,1));
+
+    model.undo();
+    model.undo();
+    model.waitForEdits();
+    QCOMPARE(model.data(model.index(2,3)).toString(),QString("r2c3"));
+    QVERIFY(!model.find(removed));
+    QVERIFY(model.cellRect(removed).isEmpty());
+}
+
+//each save after an edit writes only the changes, a fresh model reading the
+//table must see what the editing one shows
+void mergeTableTest::incrementalSave()
+{
+    mergeModel model(nullptr);
+    fillTable(model,8,8);
+    model.initTable("incremental");
+    QVERIFY(model.savetoDb("incremental"));
+
+    const QList<std::function<void()>> edits = {
+        [&]{ model.setData(model.index(0,0),QString("edited")); },
+        [&]{ model.insertRows_(3,2); },
+        [&]{ model.setData(model.index(4,5),QString("in a new row")); },
+        [&]{ model.removeColumn_(2); },
+        [&]{ model.merge(6,3,2,3); },
+        [&]{ model.split(1,1); },
+        [&]{ model.removeRows_(0,2); },
+        [&]{ model.insertColumns_(0,1); },
+        [&]{ model.undo(); },
+        [&]{ model.undo(); },
+        [&]{ model.redo(); },
+    };
+    for(int i = 0; i < edits.size(); i++)
+    {
+        edits.at(i)();
+        model.waitForEdits();
+        QVERIFY(model.savetoDb("incremental"));
+        mergeModel loaded(nullptr);
+        QVERIFY(loaded.loadFromDb("incremental"));
+        QVERIFY2(tableText(loaded) == tableText(model),qPrintable(QString("after edit %1").arg(i)));
+    }
+}
+
+void mergeTableTest::malformedJson_data()
+{
+    QTest::addColumn<QByteArray>("json");
+    QTest::newRow("empty") << QByteArray("");
+    QTest::newRow("unclosed object") << QByteArray("{");
+    QTest::newRow("unclosed cells") << QByteArray("{\"cells\": [");
+    QTest::newRow("trailing comma") << QByteArray("{\"cells\": [{\"row\": 0,}]}");
+    QTest::newRow("missing comma") << QByteArray("{\"cells\": [{\"row\": 0 \"col\": 1}]}");
+    QTest::newRow("unclosed string") << QByteArray("{\"cells\": [{\"val\": \"abc}]}");
+    QTest::newRow("bad escape") << QByteArray("{\"cells\": [{\"val\": \"\\q\"}]}");
+    QTest::newRow("short unicode escape") << QByteArray("{\"cells\": [{\"val\": \"\\u12\"}]}");
+    QTest::newRow("missing colon") << QByteArray("{\"cells\" [{\"row\": 0}]}");
+    QTest::newRow("row out of range") << QByteArray("{\"cells\": [{\"row\": 1e300}]}");
+    QTest::newRow("span past int") << QByteArray("{\"cells\": [{\"rowSpan\": 2147483648}]}");
+    QTest::newRow("fractional col") << QByteArray("{\"cells\": [{\"col\": 1.5}]}");
+    QTest::newRow("rows out of range") << QByteArray("{\"rows\": 1e20, \"cells\": []}");
+    QTest::newRow("too deep") << "{\"extra\": " + QByteArray(1000,'[') + QByteArray(1000,']') + "}";
+}
+
+//a broken file is refused, and loading it leaves the table as it was
+void mergeTableTest::malformedJson()
+{
+    QFETCH(QByteArray,json);
+    auto fileName = m_dir.filePath("malformed.json");
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(json),json.size());
+    file.close();
+
+    TableState state;
+    QVERIFY(!readJson(fileName,state));
+
+    mergeModel model(nullptr);
+    fillTable(model,4,4);
+    auto before = tableText(model);
+    model.loadFromJson(fileName);
+    QVERIFY(tableText(model) == before);
+}
+
+//records that reach past the extents, have no area or overlap another are
+//refused like a bad value offset
+void mergeTableTest::corruptBinary()
+{
+    mergeModel model(nullptr);
+    fillTable(model,4,4);
+    auto fileName = m_dir.filePath("corrupt.mtab");
+    QVERIFY(model.savetoBinary(fileName));
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    auto good = file.readAll();
+    file.close();
+
+    //the header is 64 bytes, then 32 byte records of id, row, col, rowSpan, colSpan
+    auto field = [&good](int record, int offset){
+        qint32 value;
+        memcpy(&value,good.constData()+64+record*32+offset,sizeof(value));
+        return value;
+    };
+    auto opens = [&](const QList<QPair<int,qint32>> &patches){
+        auto bytes = good;
+        for(auto &&patch : patches)
+            memcpy(bytes.data()+64+patch.first,&patch.second,sizeof(qint32));
+        QFile out(fileName);
+        if(!out.open(QIODevice::WriteOnly) || out.write(bytes) != bytes.size())
+            return false;
+        out.close();
+        tableFile table;
+        TableState state;
+        return table.open(fileName,state);
+    };
+    QVERIFY(opens({}));
+    QVERIFY(!opens({{12,0}}));
+    QVERIFY(!opens({{16,-1}}));
+    QVERIFY(!opens({{4,-1}}));
+    QVERIFY(!opens({{4,4}}));
+    QVERIFY(!opens({{8,4-field(0,16)+1}}));
+    QVERIFY(!opens({{4,field(1,4)},{8,field(1,8)},{12,1},{16,1}}));
+    QVERIFY(!opens({{12,0x7fffffff}}));
+}
+
+//cutting every row of a dense table leaves its columns, so the views that
+//were only told about the rows still count right; undo brings the rows back
+void mergeTableTest::removeEverything()
+{
+    mergeModel model(nullptr);
+    fillTable(model,4,5);
+    int columns = model.columnCount();
+    int changed = 0;
+    connect(&model,&QAbstractItemModel::columnsRemoved,&model,[&]{ changed++; });
+    connect(&model,&QAbstractItemModel::columnsInserted,&model,[&]{ changed++; });
+    auto before = tableText(model);
+
+    model.removeRows_(0,model.rowCount());
+    model.waitForEdits();
+    QCOMPARE(model.columnCount(),columns);
+
+    model.undo();
+    model.waitForEdits();
+    QVERIFY(tableText(model) == before);
+
+    //more rows go in under the columns that were kept
+    model.removeRows_(0,model.rowCount());
+    model.insertRows_(0,2);
+    model.waitForEdits();
+    QCOMPARE(model.rowCount(),2);
+    QCOMPARE(model.columnCount(),columns);
+    QCOMPARE(tableText(model).size(),2*columns);
+    QCOMPARE(changed,0);
+}
+
+//producers on several threads push at once, a frame later each position
+//holds its last value; on a paged table an evicted band gets its values when
+//it is read back
+void mergeTableTest::ingestProducers()
+{
+    mergeModel model(nullptr);
+    fillTable(model,30,8);
+    QThreadPool producers;
+    producers.setMaxThreadCount(4);
+    for(int p = 0; p < 4; p++)
+    {
+        producers.start([&model,p]{
+            for(int round = 0; round < 50; round++)
+                for(int row = 0; row < 30; row++)
+                    for(int col = 2*p; col < 2*p+2; col++)
+                        model.ingest(row,col,QString("v%1").arg(round));
+        });
+    }
+    producers.waitForDone();
+    QList<QStringList> last(30,QStringList(8,"v49"));
+    QTRY_VERIFY(model.values(QRect(0,0,8,30)) == last);
+
+    model.initTable("ingest");
+    QVERIFY(model.savetoDb("ingest"));
+    mergeModel paged(nullptr);
+    QVERIFY(paged.loadFromDbPaged("ingest",2));
+    while(paged.canFetchMore(QModelIndex()))
+        paged.fetchMore(QModelIndex());
+    //painting the end leaves the first band farthest away
+    paged.data(paged.index(29,0));
+    paged.setPageBudget(0);
+    paged.ingest(0,3,"evicted");
+    QTest::qWait(INGESTFRAME*4);
+    QCOMPARE(paged.values(QRect(3,0,1,1)),QList<QStringList>{{"evicted"}});
+    QVERIFY(paged.savetoDb("ingest"));
+    mergeModel loaded(nullptr);
+    QVERIFY(loaded.loadFromDb("ingest"));
+    QCOMPARE(loaded.data(loaded.index(0,3)).toString(),QString("evicted"));
+}
+
+//with no budget every entry but the newest goes to the temp file, and comes
+//back out of it whole
+void mergeTableTest::undoSpill()
+{
+    mergeModel model(nullptr);
+    fillTable(model,4,4);
+    model.setUndoBudget(0);
+
+    //the table after each undo step, column 0 holds no covered position
+    QList<QStringList> states = {tableText(model)};
+    for(int i = 0; i < 40; i++)
+    {
+        model.setData(model.index(i%4,0),QString(1000,QChar('a'+i%26)));
+        states.append(tableText(model));
+        if(i%10 == 9)
+        {
+            model.insertRows_(i%4,1);
+            model.waitForEdits();
+            states.append(tableText(model));
+        }
+    }
+    QVERIFY(model.memoryUsage().spilled > 0);
+
+    for(int i = states.size()-2; i >= 0; i--)
+    {
+        model.undo();
+        model.waitForEdits();
+        QVERIFY2(tableText(model) == states.at(i),qPrintable(QString("undo to step %1").arg(i)));
+    }
+    for(int i = 1; i < states.size(); i++)
+    {
+        model.redo();
+        model.waitForEdits();
+        QVERIFY2(tableText(model) == states.at(i),qPrintable(QString("redo to step %1").arg(i)));
+    }
+}
+
+QTEST_GUILESS_MAIN(mergeTableTest)
+
+#include "mergeTableTest.moc"
@@ -0,0 +1,82 @@
+#include "sqliteBackend.h"
+#include "tableDb.h"
+#include <QAtomicInt>
+
+sqliteBackend::sqliteBackend(const QString &fileName, const QString &tableName)
+    : m_fileName(fileName)
+    , m_tableName(tableName)
+{
+}
+
+sqliteBackend::~sqliteBackend()
+{
+    if(m_connection.isEmpty())
+        return;
+    //the statements go before their connection
+    m_table.reset();
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connection);
+}
+
+void sqliteBackend::install()
+{
+    registerDatabase([](const QString &fileName, const QString &tableName){
+        return std::unique_ptr<tableBackend>(new sqliteBackend(fileName,tableName));
+    });
+}
+
+tableDb &sqliteBackend::table()
+{
+    if(!m_table)
+    {
+        static QAtomicInt serial;
+        m_connection = QString("sqliteBackend-%1").arg(serial.fetchAndAddRelaxed(1));
+        m_db = tableDb::open(m_fileName,m_connection);
+        m_table = std::make_unique<tableDb>(m_db,m_tableName);
+    }
+    return *m_table;
+}
+
+bool sqliteBackend::read(TableState &state, const ioProgress &progress)
+{
+    return table().read(state,progress);
+}
+
+bool sqliteBackend::write(const TableState &state, const ioProgress &progress)
+{
+    SaveJournal journal;
+    journal.table = m_tableName;
+    return table().create() && table().write(state,journal,{},progress);
+}
+
+bool sqliteBackend::create()
+{
+    return table().create();
+}
+
+qint64 sqliteBackend::count()
+{
+    return table().count();
+}
+
+bool sqliteBackend::writeChanges(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                                 const ioProgress &progress)
+{
+    return table().write(state,journal,dirty,progress);
+}
+
+bool sqliteBackend::extents(int &rows, int &cols, int &lastId, bool &sparse)
+{
+    return table().extents(rows,cols,lastId,sparse);
+}
+
+int sqliteBackend::bandEnd(int first, int last)
+{
+    return table().bandEnd(first,last);
+}
+
+bool sqliteBackend::readBand(int first, int last, QList<Cell> &cells)
+{
+    return table().readBand(first,last,cells);
+}
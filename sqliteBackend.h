@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QSqlDatabase>
+#include <memory>
+#include "tableBackend.h"
+
+class tableDb;
+
+// A table of an SQLite database, see tableDb. The connection is opened on
+// first use and kept, with the table's prepared statements, for as long as
+// the backend: use it from one thread, another one opens its own.
+class sqliteBackend : public tableBackend
+{
+public:
+    sqliteBackend(const QString &fileName, const QString &tableName = DBTABLE);
+    ~sqliteBackend() override;
+    sqliteBackend(const sqliteBackend &) = delete;
+    sqliteBackend &operator=(const sqliteBackend &) = delete;
+
+    bool read(TableState &state, const ioProgress &progress = {}) override;
+    //replaces whatever the table held
+    bool write(const TableState &state, const ioProgress &progress = {}) override;
+    bool create() override;
+    qint64 count() override;
+    bool writeChanges(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                      const ioProgress &progress = {}) override;
+    bool extents(int &rows, int &cols, int &lastId, bool &sparse) override;
+    int bandEnd(int first, int last) override;
+    bool readBand(int first, int last, QList<Cell> &cells) override;
+
+    //makes it the backend of databases, see tableBackend::forFile
+    static void install();
+
+private:
+    tableDb &table();
+
+    QString m_fileName;
+    QString m_tableName;
+    QString m_connection;                   //empty until opened
+    QSqlDatabase m_db;
+    std::unique_ptr<tableDb> m_table;
+};
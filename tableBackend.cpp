@@ -0,0 +1,92 @@
+#include "tableBackend.h"
+#include "tableFile.h"
+#include "tableTrace.h"
+#include <QFileInfo>
+
+QHash<QString,tableBackend::factory> &tableBackend::factories()
+{
+    static QHash<QString,factory> makers{
+        {"json", [](const QString &fileName){ return std::unique_ptr<tableBackend>(new jsonBackend(fileName)); }},
+        {"mtab", [](const QString &fileName){ return std::unique_ptr<tableBackend>(new binaryBackend(fileName)); }},
+    };
+    return makers;
+}
+
+void tableBackend::registerSuffix(const QString &suffix, factory make)
+{
+    factories().insert(suffix.toLower(),std::move(make));
+}
+
+tableBackend::tableFactory &tableBackend::databases()
+{
+    static tableFactory make;
+    return make;
+}
+
+void tableBackend::registerDatabase(tableFactory make)
+{
+    databases() = std::move(make);
+}
+
+std::unique_ptr<tableBackend> tableBackend::forTable(const QString &fileName, const QString &tableName)
+{
+    auto &make = databases();
+    if(!make)
+        return {};
+    return make(fileName,tableName);
+}
+
+std::unique_ptr<tableBackend> tableBackend::forFile(const QString &fileName)
+{
+    //a colon past a drive letter, with no directory after it, names the table
+    auto colon = fileName.lastIndexOf(':');
+    if(colon > 1 && !fileName.mid(colon).contains('/') && !fileName.mid(colon).contains('\\'))
+        return forTable(fileName.left(colon),fileName.mid(colon+1));
+
+    auto make = factories().value(QFileInfo(fileName).suffix().toLower());
+    if(make)
+        return make(fileName);
+    return forTable(fileName);
+}
+
+//a store without journals can still take a full save
+bool tableBackend::writeChanges(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                                const ioProgress &progress)
+{
+    return journal.full && write(state,progress);
+}
+
+jsonBackend::jsonBackend(const QString &fileName)
+    : m_fileName(fileName)
+{
+}
+
+bool jsonBackend::read(TableState &state, const ioProgress &progress)
+{
+    return readJson(m_fileName,state,progress);
+}
+
+bool jsonBackend::write(const TableState &state, const ioProgress &progress)
+{
+    return writeJson(m_fileName,state,progress);
+}
+
+binaryBackend::binaryBackend(const QString &fileName)
+    : m_fileName(fileName)
+{
+}
+
+bool binaryBackend::read(TableState &state, const ioProgress &progress)
+{
+    //mapped, there is nothing to report
+    auto file = std::make_shared<tableFile>();
+    if(!file->open(m_fileName,state))
+        return false;
+    m_file = file;
+    return true;
+}
+
+bool binaryBackend::write(const TableState &state, const ioProgress &progress)
+{
+    return tableFile::write(m_fileName,state,progress);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QHash>
+#include <functional>
+#include <memory>
+#include "mergeModel.h"
+#include "tableIO.h"
+
+#define DBTABLE "cellTable"     //table of a database named without one
+
+// Where a table is read from and written to: the CLI, the model's load/save,
+// its JSON and binary files and its Db functions go through here. Read cells
+// carry their positions in row/col, as tableIO leaves them.
+//
+// Databases come from the backend registered with registerDatabase, see
+// sqliteBackend; the model's incremental saves and paged reads need one.
+class tableBackend
+{
+public:
+    virtual ~tableBackend() = default;
+
+    virtual bool read(TableState &state, const ioProgress &progress = {}) = 0;
+    virtual bool write(const TableState &state, const ioProgress &progress = {}) = 0;
+    //file the values of the last read point into, if any
+    virtual std::shared_ptr<tableFile> file() const { return {}; }
+
+    //stores that keep cells as rows, false or -1 where they don't.
+    //The table, created when missing
+    virtual bool create() { return false; }
+    virtual qint64 count() { return -1; }
+    //writes the journal's changes, or every cell when journal.full; 'dirty' are
+    //the positions in state.cells of the journal's dirty ids
+    virtual bool writeChanges(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                              const ioProgress &progress = {});
+    //paged reading, see mergeModel::loadFromDbPaged. Cells keep their positions in row/col.
+    //Extents, largest id and storage mode of the stored table
+    virtual bool extents(int &rows, int &cols, int &lastId, bool &sparse) { return false; }
+    //the last row of the band first..last once it is grown over the merged cells anchored in it
+    virtual int bandEnd(int first, int last) { return last; }
+    //cells anchored on rows first..last
+    virtual bool readBand(int first, int last, QList<Cell> &cells) { return false; }
+
+    //by the file's suffix: .json, .mtab, or a database otherwise,
+    //"file.db:table" naming its table. Null if nothing handles the file
+    static std::unique_ptr<tableBackend> forFile(const QString &fileName);
+    //a table of a database, null if no database backend is registered
+    static std::unique_ptr<tableBackend> forTable(const QString &fileName, const QString &tableName = DBTABLE);
+    //adds or replaces the backend of a suffix
+    using factory = std::function<std::unique_ptr<tableBackend>(const QString&)>;
+    static void registerSuffix(const QString &suffix, factory make);
+    //sets the backend of databases, made with their file and table names
+    using tableFactory = std::function<std::unique_ptr<tableBackend>(const QString&, const QString&)>;
+    static void registerDatabase(tableFactory make);
+
+private:
+    static QHash<QString,factory> &factories();
+    static tableFactory &databases();
+};
+
+class jsonBackend : public tableBackend
+{
+public:
+    jsonBackend(const QString &fileName);
+    bool read(TableState &state, const ioProgress &progress = {}) override;
+    bool write(const TableState &state, const ioProgress &progress = {}) override;
+
+private:
+    QString m_fileName;
+};
+
+//see tableFile; the mapping stays open as long as this backend or a table read through it
+class binaryBackend : public tableBackend
+{
+public:
+    binaryBackend(const QString &fileName);
+    bool read(TableState &state, const ioProgress &progress = {}) override;
+    bool write(const TableState &state, const ioProgress &progress = {}) override;
+    std::shared_ptr<tableFile> file() const override { return m_file; }
+
+private:
+    QString m_fileName;
+    std::shared_ptr<tableFile> m_file;
+};
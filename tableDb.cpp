@@ -0,0 +1,454 @@
+#include "tableDb.h"
+#include "tableTrace.h"
+#include <QSqlError>
+
+//the steps bringing a table to each version from the one before, %1 being its name
+static const QList<QStringList> &migrations()
+{
+    static const QList<QStringList> steps{
+        {"CREATE TABLE IF NOT EXISTS %1 ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+         "value TEXT, "
+         "row INTEGER, "
+         "col INTEGER, "
+         "rowSpan INTEGER, "
+         "colSpan INTEGER)"},
+        //bands are read by row, and grown over merged cells through a partial
+        //index holding only those, so neither scans the whole table
+        {"CREATE INDEX IF NOT EXISTS %1_pos ON %1 (row, col)",
+         "CREATE INDEX IF NOT EXISTS %1_merged ON %1 (row, rowSpan) WHERE rowSpan > 1"},
+        //sparse tables wrote this before it was part of the schema
+        {"CREATE TABLE IF NOT EXISTS %1_extent (rows INTEGER, cols INTEGER)"},
+    };
+    return steps;
+}
+
+//by Statement. Selected cells come in readCell's column order
+static const char *statementSql[] = {
+    "INSERT OR REPLACE INTO %1 (id, value, row, col, rowSpan, colSpan) VALUES (?, ?, ?, ?, ?, ?)",
+    "DELETE FROM %1 WHERE id = ?",
+    "UPDATE %1 SET row = row + ? WHERE row >= ?",
+    "UPDATE %1 SET col = col + ? WHERE col >= ?",
+    "DELETE FROM %1",
+    "SELECT COUNT(*) FROM %1",
+    "SELECT id, value, row, col, rowSpan, colSpan FROM %1",
+    "SELECT id, value, row, col, rowSpan, colSpan FROM %1 WHERE row >= ? AND row <= ?",
+    "SELECT MAX(row + rowSpan) - 1 FROM %1 WHERE rowSpan > 1 AND row >= ? AND row <= ?",
+    "SELECT MAX(row + rowSpan), MAX(col + colSpan), MAX(id) FROM %1",
+    "DELETE FROM %1_extent",
+    "INSERT INTO %1_extent (rows, cols) VALUES (?, ?)",
+    "SELECT rows, cols FROM %1_extent",
+};
+
+static Cell readCell(const QSqlQuery &query)
+{
+    Cell cell;
+    cell.id = query.value(0).toInt();
+    cell.val = query.value(1).toString();
+    cell.row = query.value(2).toInt();
+    cell.col = query.value(3).toInt();
+    cell.rowSpan = query.value(4).toInt();
+    cell.colSpan = query.value(5).toInt();
+    return cell;
+}
+
+//bind the columns chunk by chunk, so a long batch can report and be canceled
+static bool execChunked(QSqlQuery &query, const QList<QVariantList> &columns,
+                        int &done, int total, const ioProgress &progress)
+{
+    auto size = columns.first().size();
+    for(qsizetype first = 0; first < size; first += IOCHUNKSIZE)
+    {
+        auto count = qMin<qsizetype>(IOCHUNKSIZE,size-first);
+        for(int i = 0; i < columns.size(); i++)
+            query.bindValue(i,columns[i].mid(first,count));
+        if(!query.execBatch())
+        {
+            qCWarning(lcIO) << "Failed to write cells:" << query.lastError();
+            return false;
+        }
+        done += count;
+        if(!ioReport(progress,done,total))
+            return false;
+    }
+    return true;
+}
+
+tableDb::tableDb(QSqlDatabase db, const QString &tableName)
+    : m_db(db)
+    , m_table(tableName)
+{
+}
+
+tableDb::~tableDb() = default;
+
+QSqlDatabase tableDb::open(const QString &fileName, const QString &connectionName)
+{
+    auto db = QSqlDatabase::addDatabase("QSQLITE",connectionName);
+    db.setDatabaseName(fileName);
+    if(!db.open())
+    {
+        qCWarning(lcIO) << "Falied to open database!"<<db.lastError().text();
+        return db;
+    }
+    QSqlQuery query(db);
+    if(!query.exec("PRAGMA journal_mode=WAL") || !query.exec("PRAGMA synchronous=NORMAL"))
+        qCWarning(lcIO) << "Failed to tune the database:" << query.lastError();
+    return db;
+}
+
+bool tableDb::create()
+{
+    return upgrade(true);
+}
+
+bool tableDb::migrate()
+{
+    return upgrade(false);
+}
+
+//the version recorded for the table, 1 for one from before versions, 0 for none
+int tableDb::version()
+{
+    QSqlQuery query(m_db);
+    query.prepare("SELECT version FROM " DBSCHEMATABLE " WHERE tableName = ?");
+    query.bindValue(0,m_table);
+    if(query.exec() && query.next())
+        return query.value(0).toInt();
+    query.prepare("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = ? COLLATE NOCASE");
+    query.bindValue(0,m_table);
+    if(!query.exec() || !query.next())
+    {
+        qCWarning(lcIO) << "Failed to read the schema:" << query.lastError();
+        return -1;
+    }
+    return query.value(0).toInt() > 0 ? 1 : 0;
+}
+
+bool tableDb::runSteps(const QStringList &steps)
+{
+    QSqlQuery query(m_db);
+    for(auto &&step : steps)
+    {
+        if(!query.exec(QString(step).arg(m_table)))
+        {
+            qCWarning(lcIO) << "Failed to update the schema:" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+//all steps and the new version go in one transaction, a failed migration leaves the table as it was
+bool tableDb::upgrade(bool create)
+{
+    if(m_migrated)
+        return true;
+    if(!m_db.isOpen())
+    {
+        qCWarning(lcIO) << "db not open!";
+        return false;
+    }
+    auto from = version();
+    if(from < 0 || (from == 0 && !create))
+        return false;
+    if(from > DBSCHEMA)
+    {
+        qCWarning(lcIO) << m_table << "has schema" << from << "from a newer version, this one knows" << DBSCHEMA;
+        return false;
+    }
+    if(from < DBSCHEMA)
+    {
+        TRACE_SCOPE("migrate");
+        m_db.transaction();
+        bool ok = runSteps({"CREATE TABLE IF NOT EXISTS " DBSCHEMATABLE " (tableName TEXT PRIMARY KEY, version INTEGER)"});
+        for(int version = from; ok && version < DBSCHEMA; version++)
+            ok = runSteps(migrations().at(version));
+        QSqlQuery query(m_db);
+        if(ok)
+        {
+            query.prepare("INSERT OR REPLACE INTO " DBSCHEMATABLE " (tableName, version) VALUES (?, ?)");
+            query.bindValue(0,m_table);
+            query.bindValue(1,DBSCHEMA);
+            ok = query.exec();
+        }
+        if(!ok || !m_db.commit())
+        {
+            qCWarning(lcIO) << "Failed to migrate" << m_table << ":" << query.lastError();
+            m_db.rollback();
+            return false;
+        }
+        qCDebug(lcIO) << "Migrated" << m_table << "from schema" << from << "to" << DBSCHEMA;
+    }
+    m_migrated = true;
+    return true;
+}
+
+//prepared once; nullptr if that fails, e.g. for a table that isn't there
+QSqlQuery *tableDb::statement(Statement which)
+{
+    auto &query = m_statements[which];
+    if(!query)
+    {
+        query.reset(new QSqlQuery(m_db));
+        //results are read once, front to back
+        query->setForwardOnly(true);
+        if(!query->prepare(QString(statementSql[which]).arg(m_table)))
+        {
+            qCWarning(lcIO) << "Failed to prepare:" << query->lastError();
+            query.reset();
+        }
+    }
+    return query.get();
+}
+
+qint64 tableDb::count()
+{
+    auto query = statement(Count);
+    if(!query || !query->exec() || !query->next())
+        return 0;
+    auto count = query->value(0).toLongLong();
+    query->finish();
+    return count;
+}
+
+//a sparse table keeps its extents beside the cells, a dense one has none
+bool tableDb::writeExtent(const TableState &state)
+{
+    auto clear = statement(ClearExtent);
+    if(!clear || !clear->exec())
+    {
+        qCWarning(lcIO) << "Failed to clear extent:" << (clear ? clear->lastError() : m_db.lastError());
+        return false;
+    }
+    if(!state.sparse)
+        return true;
+    auto insert = statement(InsertExtent);
+    if(!insert)
+        return false;
+    insert->bindValue(0,state.rowMap.size());
+    insert->bindValue(1,state.colMap.size());
+    if(!insert->exec())
+    {
+        qCWarning(lcIO) << "Failed to write extent:" << insert->lastError();
+        return false;
+    }
+    return true;
+}
+
+//false for a dense table, which has no extents stored
+bool tableDb::readExtent(int &rows, int &cols)
+{
+    auto query = statement(SelectExtent);
+    if(!query || !query->exec() || !query->next())
+        return false;
+    rows = query->value(0).toInt();
+    cols = query->value(1).toInt();
+    query->finish();
+    return true;
+}
+
+//moved rows/columns become one UPDATE each, removed and edited cells go out in two batches
+bool tableDb::writeChanges(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                           const ioProgress &progress)
+{
+    int total = journal.full ? state.cells.size()+1 :
+                    journal.shifts.size()+journal.removed.size()+dirty.size();
+    int done = 0;
+    if(!ioReport(progress,done,total) || !writeExtent(state))
+        return false;
+
+    if(journal.full)
+    {
+        //every cell is rewritten: into a bare table, indexed once at the end
+        auto clear = statement(Clear);
+        if(!runSteps({"DROP INDEX IF EXISTS %1_pos", "DROP INDEX IF EXISTS %1_merged"}) ||
+           !clear || !clear->exec())
+        {
+            qCWarning(lcIO) << "Failed to clear table:" << (clear ? clear->lastError() : m_db.lastError());
+            return false;
+        }
+        done++;
+    }else
+    {
+        auto rowQuery = statement(ShiftRows);
+        auto colQuery = statement(ShiftCols);
+        for(auto &&shift : journal.shifts)
+        {
+            auto shiftQuery = shift.rows ? rowQuery : colQuery;
+            if(!shiftQuery)
+                return false;
+            shiftQuery->bindValue(0,shift.delta);
+            shiftQuery->bindValue(1,shift.from);
+            if(!shiftQuery->exec())
+            {
+                qCWarning(lcIO) << "Failed to move cells:" << shiftQuery->lastError();
+                return false;
+            }
+            if(!ioReport(progress,++done,total))
+                return false;
+        }
+
+        if(!journal.removed.isEmpty())
+        {
+            QVariantList ids;
+            for(auto id : journal.removed)
+                ids << id;
+            auto remove = statement(Remove);
+            if(!remove || !execChunked(*remove,{ids},done,total,progress))
+                return false;
+        }
+    }
+
+    QVariantList ids, values, rows, cols, rowSpans, colSpans;
+    auto bind = [&](const Cell &cell){
+        ids << cell.id;
+        values << cell.val;
+        rows << state.rowMap.toLogical(cell.row);
+        cols << state.colMap.toLogical(cell.col);
+        rowSpans << cell.rowSpan;
+        colSpans << cell.colSpan;
+    };
+    if(journal.full)
+    {
+        for(auto &&cell : state.cells)
+            bind(cell);
+    }else
+    {
+        for(auto i : dirty)
+            bind(state.cells.at(i));
+    }
+
+    auto insert = statement(Insert);
+    if(!ids.isEmpty() && (!insert || !execChunked(*insert,{ids,values,rows,cols,rowSpans,colSpans},done,total,progress)))
+        return false;
+    return !journal.full || runSteps(migrations().at(1));
+}
+
+bool tableDb::write(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                    const ioProgress &progress)
+{
+    if(!m_db.isOpen())
+    {
+        qCWarning(lcIO) << "database open failed";
+        return false;
+    }
+    if(!migrate())
+        return false;
+
+    m_db.transaction();
+    if(!writeChanges(state,journal,dirty,progress))
+    {
+        m_db.rollback(); // Rollback the transaction on failure
+        return false;
+    }
+
+    // Commit the transaction
+    if(!m_db.commit())
+    {
+        qCWarning(lcIO) << "Failed to commit:" << m_db.lastError();
+        m_db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool tableDb::read(TableState &state, const ioProgress &progress)
+{
+    if(!migrate())
+        return false;
+
+    auto total = count();
+    auto query = statement(SelectAll);
+    if(!query || !query->exec())
+    {
+        qCWarning(lcIO) << "Failed to select: "<<(query ? query->lastError() : m_db.lastError()).text();
+        return false;
+    }
+
+    state.cells.reserve(total);
+    while(query->next())
+    {
+        state.cells.append(readCell(*query));
+        if(state.cells.size() % IOCHUNKSIZE == 0 && !ioReport(progress,state.cells.size(),total))
+        {
+            query->finish();
+            return false;
+        }
+    }
+    query->finish();
+    int rows = 0;
+    int cols = 0;
+    if(readExtent(rows,cols))
+    {
+        state.sparse = true;
+        state.rowMap.reset(rows);
+        state.colMap.reset(cols);
+    }
+    return ioReport(progress,state.cells.size(),state.cells.size());
+}
+
+bool tableDb::extents(int &rows, int &cols, int &lastId, bool &sparse)
+{
+    if(!migrate())
+        return false;
+
+    auto query = statement(Extents);
+    if(!query || !query->exec() || !query->next())
+    {
+        qCWarning(lcIO) << "Failed to read table size:" << (query ? query->lastError() : m_db.lastError());
+        return false;
+    }
+    rows = query->value(0).toInt();
+    cols = query->value(1).toInt();
+    lastId = query->value(2).isNull() ? -1 : query->value(2).toInt();
+    query->finish();
+    int extentRows = 0;
+    int extentCols = 0;
+    sparse = readExtent(extentRows,extentCols);
+    rows = qMax(rows,extentRows);
+    cols = qMax(cols,extentCols);
+    return true;
+}
+
+int tableDb::bandEnd(int first, int last)
+{
+    auto query = statement(BandEnd);
+    if(!query)
+        return last;
+    //rows the band grew by may hold merged cells reaching further still
+    for(;;)
+    {
+        query->bindValue(0,first);
+        query->bindValue(1,last);
+        if(!query->exec() || !query->next())
+        {
+            qCWarning(lcIO) << "Failed to read merged cells:" << query->lastError();
+            return last;
+        }
+        auto end = query->value(0);
+        query->finish();
+        if(end.isNull() || end.toInt() <= last)
+            return last;
+        first = last+1;
+        last = end.toInt();
+    }
+}
+
+bool tableDb::readBand(int first, int last, QList<Cell> &cells)
+{
+    auto query = statement(SelectBand);
+    if(!query)
+        return false;
+    query->bindValue(0,first);
+    query->bindValue(1,last);
+    if(!query->exec())
+    {
+        qCWarning(lcIO) << "Failed to select: "<<query->lastError().text();
+        return false;
+    }
+    while(query->next())
+        cells.append(readCell(*query));
+    query->finish();
+    return true;
+}
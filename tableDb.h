@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <memory>
+#include "mergeModel.h"
+#include "tableIO.h"
+
+#define DBSCHEMA 3                          //version of the cell tables this build writes
+#define DBSCHEMATABLE "mergetable_schema"   //version of each cell table in a database
+
+// One cell table of an SQLite database. Its statements are prepared on first
+// use and kept for as long as the object, which lives as long as its
+// connection: see sqliteBackend.
+//
+// Tables carry a schema version, and are migrated up to DBSCHEMA when first
+// touched:
+//   1  the cells: id, value, row, col, rowSpan, colSpan
+//   2  indexes on (row, col) and on the merged cells' rows
+//   3  %1_extent: the rows and columns of a sparse table, empty for a dense one
+// Tables written before versions were recorded count as 1.
+class tableDb
+{
+public:
+    tableDb(QSqlDatabase db, const QString &tableName);
+    ~tableDb();
+    tableDb(const tableDb &) = delete;
+    tableDb &operator=(const tableDb &) = delete;
+
+    //a connection in WAL mode, so bands can be read while a save writes,
+    //with synchronous=NORMAL: commits only wait for the disk at checkpoints
+    static QSqlDatabase open(const QString &fileName, const QString &connectionName);
+
+    //the table, created when missing, at DBSCHEMA
+    bool create();
+    //an existing table brought to DBSCHEMA, false if there is none
+    bool migrate();
+    QString name() const { return m_table; }
+
+    //writes the journal's changes, or every cell when journal.full; 'dirty' are
+    //the positions in state.cells of the journal's dirty ids
+    bool write(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+               const ioProgress &progress = {});
+    bool read(TableState &state, const ioProgress &progress = {});
+    qint64 count();
+
+    //paged reading, see mergeModel::loadFromDbPaged. Cells keep their positions in row/col.
+    //Extents, largest id and storage mode of the stored table
+    bool extents(int &rows, int &cols, int &lastId, bool &sparse);
+    //the last row of the band first..last once it is grown over the merged cells anchored in it
+    int bandEnd(int first, int last);
+    //cells anchored on rows first..last
+    bool readBand(int first, int last, QList<Cell> &cells);
+
+private:
+    enum Statement { Insert, Remove, ShiftRows, ShiftCols, Clear, Count, SelectAll, SelectBand,
+                     BandEnd, Extents, ClearExtent, InsertExtent, SelectExtent, StatementCount };
+    QSqlQuery *statement(Statement which);
+    bool upgrade(bool create);
+    int version();
+    bool runSteps(const QStringList &steps);
+    bool writeExtent(const TableState &state);
+    bool readExtent(int &rows, int &cols);
+    bool writeChanges(const TableState &state, const SaveJournal &journal, const QList<int> &dirty,
+                      const ioProgress &progress);
+
+    QSqlDatabase m_db;
+    QString m_table;
+    bool m_migrated = false;
+    std::unique_ptr<QSqlQuery> m_statements[StatementCount];
+};
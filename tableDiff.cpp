@@ -0,0 +1,178 @@
+#include "tableDiff.h"
+#include <QHash>
+#include <QSet>
+#include <algorithm>
+#include <climits>
+#include <tuple>
+
+//runs of ids that only one side has; false when the kept ids changed order
+static bool diffAxis(const axisMap &from, const axisMap &to,
+                     QList<QPair<int,int>> &removed, QList<QPair<int,int>> &inserted)
+{
+    int kept = 0;
+    int last = -1;
+    for(int i = 0; i < from.size(); i++)
+    {
+        auto pos = to.toLogical(from.toPhysical(i));
+        if(pos < 0)
+        {
+            if(!removed.isEmpty() && removed.last().first+removed.last().second == i)
+                removed.last().second++;
+            else
+                removed.append({i,1});
+            continue;
+        }
+        if(pos < last)
+            return false;
+        last = pos;
+        kept++;
+    }
+    if(kept == 0 && (from.size() > 0 || to.size() > 0))
+        return false;
+    std::reverse(removed.begin(),removed.end());
+
+    for(int i = 0; i < to.size(); i++)
+    {
+        if(from.toLogical(to.toPhysical(i)) >= 0)
+            continue;
+        if(!inserted.isEmpty() && inserted.last().first+inserted.last().second == i)
+            inserted.last().second++;
+        else
+            inserted.append({i,1});
+    }
+    return true;
+}
+
+//same anchor and span over the very same rows and columns
+static bool sameGeometry(const TableState &from, const Cell &a, const TableState &to, const Cell &b)
+{
+    if(a.rowSpan != b.rowSpan || a.colSpan != b.colSpan)
+        return false;
+    auto fromRow = from.rowMap.toLogical(a.row);
+    auto fromCol = from.colMap.toLogical(a.col);
+    auto toRow = to.rowMap.toLogical(b.row);
+    auto toCol = to.colMap.toLogical(b.col);
+    for(int i = 1; i < a.rowSpan; i++)
+        if(from.rowMap.toPhysical(fromRow+i) != to.rowMap.toPhysical(toRow+i))
+            return false;
+    for(int i = 1; i < a.colSpan; i++)
+        if(from.colMap.toPhysical(fromCol+i) != to.colMap.toPhysical(toCol+i))
+            return false;
+    return true;
+}
+
+//a cell lying only on inserted rows or columns is announced by the insertion
+static bool onlyInserted(const axisMap &from, const axisMap &to, int pos, int count)
+{
+    for(int i = pos; i < pos+count; i++)
+        if(from.toLogical(to.toPhysical(i)) >= 0)
+            return false;
+    return true;
+}
+
+//new positions spanned by what is left of old positions pos..pos+count-1, empty if none is
+static QPair<int,int> survivingRange(const axisMap &from, const axisMap &to, int pos, int count)
+{
+    QPair<int,int> range = {INT_MAX,-1};
+    for(int i = pos; i < pos+count; i++)
+    {
+        auto at = to.toLogical(from.toPhysical(i));
+        if(at < 0)
+            continue;
+        range.first = qMin(range.first,at);
+        range.second = qMax(range.second,at);
+    }
+    return range;
+}
+
+//merge rectangles sharing a full edge, first down the columns then along the rows
+void coalesce(QList<QRect> &rects)
+{
+    for(int pass = 0; pass < 2; pass++)
+    {
+        bool vertical = pass == 0;
+        std::sort(rects.begin(),rects.end(),[vertical](const QRect &a, const QRect &b){
+            if(vertical)
+                return std::make_tuple(a.left(),a.right(),a.top()) < std::make_tuple(b.left(),b.right(),b.top());
+            return std::make_tuple(a.top(),a.bottom(),a.left()) < std::make_tuple(b.top(),b.bottom(),b.left());
+        });
+        QList<QRect> merged;
+        for(auto &&rect : rects)
+        {
+            if(!merged.isEmpty())
+            {
+                auto &prev = merged.last();
+                if(vertical && prev.left() == rect.left() && prev.right() == rect.right() && prev.bottom()+1 >= rect.top())
+                {
+                    prev.setBottom(qMax(prev.bottom(),rect.bottom()));
+                    continue;
+                }
+                if(!vertical && prev.top() == rect.top() && prev.bottom() == rect.bottom() && prev.right()+1 >= rect.left())
+                {
+                    prev.setRight(qMax(prev.right(),rect.right()));
+                    continue;
+                }
+            }
+            merged.append(rect);
+        }
+        rects = merged;
+    }
+}
+
+TableDiff diffStates(const TableState &from, const TableState &to)
+{
+    TableDiff diff;
+    if(!diffAxis(from.rowMap,to.rowMap,diff.removedRows,diff.insertedRows) ||
+       !diffAxis(from.colMap,to.colMap,diff.removedCols,diff.insertedCols))
+    {
+        diff = TableDiff();
+        diff.reset = true;
+        return diff;
+    }
+
+    QHash<QPair<int,int>,int> anchors;
+    anchors.reserve(from.cells.size());
+    for(int i = 0; i < from.cells.size(); i++)
+        anchors.insert({from.cells.rows()[i],from.cells.cols()[i]},i);
+
+    QSet<QPair<int,int>> kept;
+    for(auto &&cell : to.cells)
+    {
+        auto i = anchors.value({cell.row,cell.col},-1);
+        bool stable = i >= 0 && sameGeometry(from,from.cells[i],to,cell);
+        if(stable)
+            kept.insert({cell.row,cell.col});
+        if(stable && from.cells.val(i) == cell.val)
+            continue;
+
+        auto row = to.rowMap.toLogical(cell.row);
+        auto col = to.colMap.toLogical(cell.col);
+        if(!stable && (cell.rowSpan > 1 || cell.colSpan > 1))
+            diff.newSpans.append(QRect(col,row,cell.colSpan,cell.rowSpan));
+        if(onlyInserted(from.rowMap,to.rowMap,row,cell.rowSpan) ||
+           onlyInserted(from.colMap,to.colMap,col,cell.colSpan))
+            continue;
+        diff.changed.append(QRect(col,row,cell.colSpan,cell.rowSpan));
+    }
+
+    //dense cells tile the table, so whatever an old cell covered is repainted
+    //through the new cells now covering it; only its span has to go. A sparse
+    //side may leave that area to the default, which is repainted here
+    bool sparse = from.sparse || to.sparse;
+    for(auto &&cell : from.cells)
+    {
+        if(kept.contains({cell.row,cell.col}))
+            continue;
+        if(cell.rowSpan > 1 || cell.colSpan > 1)
+            diff.clearedSpans.append(QPoint(from.colMap.toLogical(cell.col),from.rowMap.toLogical(cell.row)));
+        if(!sparse)
+            continue;
+        auto rows = survivingRange(from.rowMap,to.rowMap,from.rowMap.toLogical(cell.row),cell.rowSpan);
+        auto cols = survivingRange(from.colMap,to.colMap,from.colMap.toLogical(cell.col),cell.colSpan);
+        if(rows.first <= rows.second && cols.first <= cols.second)
+            diff.changed.append(QRect(QPoint(cols.first,rows.first),QPoint(cols.second,rows.second)));
+    }
+
+    coalesce(diff.changed);
+    return diff;
+}
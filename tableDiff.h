@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include "mergeModel.h"
+
+// What a view has to be told to go from one TableState to another.
+// Rows and columns are matched through their physical ids, so the new state
+// must take its axes from the old one's (see mergeModel::adoptAxes). Removed
+// ids are reused, two copies edited apart may give one id to different rows.
+struct TableDiff {
+    bool reset = false;     //no ids in common on an axis, only a model reset fits
+    //(first,count) runs: removals in old positions bottom up,
+    //insertions in new positions top down
+    QList<QPair<int,int>> removedRows;
+    QList<QPair<int,int>> removedCols;
+    QList<QPair<int,int>> insertedRows;
+    QList<QPair<int,int>> insertedCols;
+    QList<QPoint> clearedSpans;     //old anchors (x = col, y = row) to drop before moving rows
+    QList<QRect> newSpans;          //new anchors and their span, set once rows are in place
+    QList<QRect> changed;           //new positions whose value or span differs
+
+    bool isEmpty() const
+    {
+        return !reset && removedRows.isEmpty() && removedCols.isEmpty() && insertedRows.isEmpty() &&
+               insertedCols.isEmpty() && clearedSpans.isEmpty() && newSpans.isEmpty() && changed.isEmpty();
+    }
+};
+
+TableDiff diffStates(const TableState &from, const TableState &to);
+//joins rectangles that share a whole edge or overlap along it, in place
+void coalesce(QList<QRect> &rects);
@@ -0,0 +1,249 @@
+#include "tableFile.h"
+#include "cellKernels.h"
+#include "cellIndex.h"
+#include "tableTrace.h"
+#include <QSaveFile>
+#include <QSysInfo>
+#include <limits>
+#include <cstring>
+
+#define TABLEFILEMAGIC "MRGTABLE"
+#define TABLEFILEVERSION 1
+#define TABLEFILECHUNK 1000     //records per write, and how often progress is reported
+#define TABLEFILESPARSE 0x1     //header flag: a sparse table, rows and cols are its extents
+
+struct FileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 cellCount;
+    quint32 mergedCount;
+    quint32 rows;
+    quint32 cols;
+    quint32 flags;
+    quint64 poolOffset;     //bytes from the start of the file
+    quint64 poolSize;       //UTF-16 units
+    quint64 padding[2];
+};
+
+struct CellRecord {
+    qint32 id;
+    qint32 row;
+    qint32 col;
+    qint32 rowSpan;
+    qint32 colSpan;
+    quint32 valOffset;      //UTF-16 units into the pool
+    quint32 valSize;
+    quint32 reserved;
+};
+
+static_assert(sizeof(FileHeader) == 64 && sizeof(CellRecord) == 32, "table file layout");
+
+//records and pool are used in place, which only works on little endian hosts
+static bool nativeLayout()
+{
+    if(QSysInfo::ByteOrder == QSysInfo::LittleEndian)
+        return true;
+    qCWarning(lcIO) << "Table files need a little endian host";
+    return false;
+}
+
+static qint64 recordsOffset()
+{
+    return sizeof(FileHeader);
+}
+
+static qint64 mergedOffset(const FileHeader &header)
+{
+    return recordsOffset() + qint64(header.cellCount)*sizeof(CellRecord);
+}
+
+static qint64 poolOffset(const FileHeader &header)
+{
+    //the pool holds char16_t, keep it 8 byte aligned
+    return (mergedOffset(header) + qint64(header.mergedCount)*sizeof(quint32) + 7) & ~qint64(7);
+}
+
+tableFile::~tableFile()
+{
+    if(m_data)
+        m_file.unmap(m_data);
+}
+
+bool tableFile::write(const QString &fileName, const TableState &state, const ioProgress &progress)
+{
+    if(!nativeLayout())
+        return false;
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCWarning(lcIO) << "Couldn't open file for writing:" << file.errorString();
+        return false;
+    }
+
+    const auto &cells = state.cells;
+    QList<int> merged;
+    selectMerged(cells.rowSpans(),cells.colSpans(),cells.size(),merged);
+    quint64 poolSize = 0;
+    for(int i = 0; i < cells.size(); i++)
+        poolSize += cells.val(i).size();
+
+    FileHeader header = {};
+    memcpy(header.magic,TABLEFILEMAGIC,sizeof(header.magic));
+    header.version = TABLEFILEVERSION;
+    header.cellCount = state.cells.size();
+    header.mergedCount = merged.size();
+    header.rows = state.rowMap.size();
+    header.cols = state.colMap.size();
+    header.flags = state.sparse ? TABLEFILESPARSE : 0;
+    header.poolOffset = poolOffset(header);
+    header.poolSize = poolSize;
+    if(poolSize > std::numeric_limits<quint32>::max())
+    {
+        qCWarning(lcIO) << "Table too large for a table file";
+        return false;
+    }
+
+    int total = state.cells.size()*2;
+    int done = 0;
+    auto put = [&file](const void *data, qint64 size){
+        return file.write(static_cast<const char*>(data),size) == size;
+    };
+    bool ok = put(&header,sizeof(header));
+
+    QList<CellRecord> records;
+    quint32 offset = 0;
+    for(int i = 0; ok && i < cells.size(); i++)
+    {
+        CellRecord record = {};
+        record.id = cells.ids()[i];
+        record.row = state.rowMap.toLogical(cells.rows()[i]);
+        record.col = state.colMap.toLogical(cells.cols()[i]);
+        record.rowSpan = cells.rowSpans()[i];
+        record.colSpan = cells.colSpans()[i];
+        record.valOffset = offset;
+        record.valSize = cells.val(i).size();
+        offset += record.valSize;
+        records.append(record);
+        if(records.size() == TABLEFILECHUNK || i == cells.size()-1)
+        {
+            ok = put(records.constData(),records.size()*sizeof(CellRecord));
+            done += records.size();
+            records.clear();
+            if(ok && !ioReport(progress,done,total))
+                return false;
+        }
+    }
+
+    const char zeros[8] = {};
+    ok = ok && put(merged.constData(),merged.size()*sizeof(quint32));
+    ok = ok && put(zeros,header.poolOffset-mergedOffset(header)-merged.size()*sizeof(quint32));
+    for(int i = 0; ok && i < cells.size(); i++)
+    {
+        const auto &val = cells.val(i);
+        ok = put(val.constData(),val.size()*sizeof(QChar));
+        if(ok && ++done % TABLEFILECHUNK == 0 && !ioReport(progress,done,total))
+            return false;
+    }
+    if(!ok)
+    {
+        qCWarning(lcIO) << "Failed to write table file:" << file.errorString();
+        return false;
+    }
+    if(!ioReport(progress,total,total))
+        return false;
+    if(!file.commit())
+    {
+        qCWarning(lcIO) << "Failed to write table file:" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool tableFile::open(const QString &fileName, TableState &state)
+{
+    if(!nativeLayout())
+        return false;
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly))
+    {
+        qCWarning(lcIO) << "Open table file failed!" << m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    if(m_size < qint64(sizeof(FileHeader)) || !(m_data = m_file.map(0,m_size)))
+    {
+        qCWarning(lcIO) << "Not a table file:" << fileName;
+        return false;
+    }
+
+    const auto &header = *reinterpret_cast<const FileHeader*>(m_data);
+    if(memcmp(header.magic,TABLEFILEMAGIC,sizeof(header.magic)) != 0 || header.version != TABLEFILEVERSION ||
+       header.poolOffset != quint64(poolOffset(header)) ||
+       header.poolOffset + header.poolSize*sizeof(QChar) > quint64(m_size))
+    {
+        qCWarning(lcIO) << "Not a table file:" << fileName;
+        return false;
+    }
+
+    if(header.flags & TABLEFILESPARSE)
+    {
+        state.sparse = true;
+        state.rowMap.reset(header.rows);
+        state.colMap.reset(header.cols);
+    }
+    auto records = reinterpret_cast<const CellRecord*>(m_data + recordsOffset());
+    auto merged = reinterpret_cast<const quint32*>(m_data + mergedOffset(header));
+    auto pool = reinterpret_cast<const QChar*>(m_data + header.poolOffset);
+    //every record has to lie inside the extents and own its area alone,
+    //the index is only built to find overlaps
+    cellIndex index;
+    auto overlaps = [&index](const CellRecord &record){
+        for(int r = record.row; r < record.row + record.rowSpan; r++)
+            for(int c = record.col; c < record.col + record.colSpan; c++)
+                if(index.owner(r,c) != -1)
+                    return true;
+        return false;
+    };
+    state.cells.resize(header.cellCount);
+    for(quint32 i = 0; i < header.cellCount; i++)
+    {
+        const auto &record = records[i];
+        if(quint64(record.valOffset) + record.valSize > header.poolSize ||
+           record.row < 0 || record.col < 0 || record.rowSpan < 1 || record.colSpan < 1 ||
+           qint64(record.row) + record.rowSpan > header.rows || qint64(record.col) + record.colSpan > header.cols ||
+           overlaps(record))
+        {
+            qCWarning(lcIO) << "Corrupt table file:" << fileName;
+            state.cells.clear();
+            return false;
+        }
+        index.fill(record.row,record.col,record.rowSpan,record.colSpan,i);
+        auto cell = state.cells[i];
+        cell.id = record.id;
+        cell.row = record.row;
+        cell.col = record.col;
+        cell.rowSpan = record.rowSpan;
+        cell.colSpan = record.colSpan;
+        //not interned: the value stays where it is until edited
+        state.cells.holdVal(i,QString::fromRawData(pool + record.valOffset,record.valSize));
+    }
+    for(quint32 i = 0; i < header.mergedCount; i++)
+    {
+        if(merged[i] >= header.cellCount)
+        {
+            qCWarning(lcIO) << "Corrupt table file:" << fileName;
+            state.cells.clear();
+            state.mergedCells.clear();
+            return false;
+        }
+        const auto &record = records[merged[i]];
+        state.mergedCells.append({record.row,record.col});
+    }
+    return true;
+}
+
+bool tableFile::maps(const QString &str) const
+{
+    auto data = reinterpret_cast<const uchar*>(str.constData());
+    return m_data && !str.isEmpty() && data >= m_data && data < m_data + m_size;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QFile>
+#include "mergeModel.h"
+#include "tableIO.h"
+
+// Binary table file: a header, one fixed-width record per cell, the merged
+// cells as record indexes and a UTF-16 string pool, all little endian.
+// Opening maps the file and hands out cells whose values point into the
+// mapping, so nothing is parsed or allocated per cell; the tableFile has to
+// outlive every such string.
+class tableFile
+{
+public:
+    ~tableFile();
+
+    static bool write(const QString &fileName, const TableState &state, const ioProgress &progress = {});
+    //state gets the cells with their positions in row/col and the merged anchors
+    //(positions too) in mergedCells
+    bool open(const QString &fileName, TableState &state);
+    //whether a value still points into the mapping
+    bool maps(const QString &str) const;
+
+private:
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+};
@@ -0,0 +1,405 @@
+#include "tableIO.h"
+#include "tableTrace.h"
+#include <QIODevice>
+#include <QFile>
+#include <QSaveFile>
+#include <QSize>
+#include <climits>
+
+bool ioReport(const ioProgress &progress, qint64 done, qint64 total)
+{
+    if(!progress || progress(done,total))
+        return true;
+    qCDebug(lcIO) << "canceled at" << done << "of" << total;
+    return false;
+}
+
+//same escaping as QJsonDocument: quotes, backslashes and control characters
+static void appendJsonString(QByteArray &out, const QString &str)
+{
+    out += '"';
+    for(auto c : str.toUtf8())
+    {
+        switch(c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if(uchar(c) < 0x20)
+                out += "\\u00" + QByteArray::number(uchar(c),16).rightJustified(2,'0');
+            else
+                out += c;
+        }
+    }
+    out += '"';
+}
+
+//written cell by cell in the layout QJsonDocument::Indented gives, so the file
+//never exists twice in memory. QSaveFile keeps the old file on failure or cancel
+bool writeJson(const QString &fileName, const TableState &state, const ioProgress &progress)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcIO) << "Couldn't open file for writing.";
+        return false;
+    }
+
+    int total = state.cells.size();
+    QByteArray out = "{\n    \"cells\": [\n";
+    for(int i = 0; i < total; i++)
+    {
+        const auto &cell = state.cells.at(i);
+        out += i == 0 ? "        {\n" : ",\n        {\n";
+        out += "            \"col\": " + QByteArray::number(state.colMap.toLogical(cell.col)) + ",\n";
+        out += "            \"colSpan\": " + QByteArray::number(cell.colSpan) + ",\n";
+        out += "            \"row\": " + QByteArray::number(state.rowMap.toLogical(cell.row)) + ",\n";
+        out += "            \"rowSpan\": " + QByteArray::number(cell.rowSpan) + ",\n";
+        out += "            \"val\": ";
+        appendJsonString(out,cell.val);
+        out += "\n        }";
+
+        if((i+1) % IOCHUNKSIZE == 0)
+        {
+            if(file.write(out) != out.size())
+            {
+                qCWarning(lcIO) << "Failed to write json:" << file.errorString();
+                return false;
+            }
+            out.clear();
+            if(!ioReport(progress,i+1,total))
+                return false;
+        }
+    }
+    out += total > 0 ? "\n    ]" : "    ]";
+    if(state.sparse)
+    {
+        out += ",\n    \"cols\": " + QByteArray::number(state.colMap.size());
+        out += ",\n    \"rows\": " + QByteArray::number(state.rowMap.size());
+    }
+    out += "\n}\n";
+    if(file.write(out) != out.size())
+    {
+        qCWarning(lcIO) << "Failed to write json:" << file.errorString();
+        return false;
+    }
+    if(!ioReport(progress,total,total))
+        return false;
+    if(!file.commit())
+    {
+        qCWarning(lcIO) << "Failed to write json:" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+#define JSONBUFSIZE (64*1024)
+#define JSONMAXDEPTH 256
+
+//pulls JSON tokens off a device a buffer at a time, for the few shapes a
+//table file has; anything else is skipped over
+class jsonReader
+{
+public:
+    explicit jsonReader(QIODevice *device) : m_device(device) {}
+
+    //next non-blank character without taking it, 0 at the end
+    char peek()
+    {
+        for(;;)
+        {
+            if(m_pos == m_buf.size() && !fill())
+                return 0;
+            auto c = m_buf.at(m_pos);
+            if(c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                return c;
+            m_pos++;
+        }
+    }
+    bool expect(char c)
+    {
+        if(peek() != c)
+            return false;
+        m_pos++;
+        return true;
+    }
+    bool readString(QString &out);
+    bool readNumber(double &out);
+    bool skipValue(int depth = 0);
+    qint64 consumed() const { return m_done + m_pos; }
+
+private:
+    bool fill()
+    {
+        m_done += m_buf.size();
+        m_buf = m_device->read(JSONBUFSIZE);
+        m_pos = 0;
+        return !m_buf.isEmpty();
+    }
+    //next character as is, 0 at the end
+    char get()
+    {
+        if(m_pos == m_buf.size() && !fill())
+            return 0;
+        return m_buf.at(m_pos++);
+    }
+    bool readHex(uint &code);
+
+    QIODevice *m_device;
+    QByteArray m_buf;
+    qsizetype m_pos = 0;
+    qint64 m_done = 0;     //bytes of the buffers before m_buf
+};
+
+bool jsonReader::readHex(uint &code)
+{
+    code = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        auto c = get();
+        int digit = c >= '0' && c <= '9' ? c-'0' :
+                    c >= 'a' && c <= 'f' ? c-'a'+10 :
+                    c >= 'A' && c <= 'F' ? c-'A'+10 : -1;
+        if(digit < 0)
+            return false;
+        code = code*16 + digit;
+    }
+    return true;
+}
+
+bool jsonReader::readString(QString &out)
+{
+    if(!expect('"'))
+        return false;
+    QByteArray utf8;
+    QString units;      //\u escapes are UTF-16, a surrogate pair takes two of them
+    for(;;)
+    {
+        auto c = get();
+        auto escaped = c == '\\' ? get() : 0;
+        if(escaped == 'u')
+        {
+            uint code;
+            if(!readHex(code))
+                return false;
+            units += QChar(char16_t(code));
+            continue;
+        }
+        if(!units.isEmpty())
+        {
+            utf8 += units.toUtf8();
+            units.clear();
+        }
+        if(c == 0)
+            return false;
+        if(c == '"')
+            break;
+        switch(escaped)
+        {
+        case 0: utf8 += c; break;
+        case '"': utf8 += '"'; break;
+        case '\\': utf8 += '\\'; break;
+        case '/': utf8 += '/'; break;
+        case 'b': utf8 += '\b'; break;
+        case 'f': utf8 += '\f'; break;
+        case 'n': utf8 += '\n'; break;
+        case 'r': utf8 += '\r'; break;
+        case 't': utf8 += '\t'; break;
+        default:
+            return false;
+        }
+    }
+    out = QString::fromUtf8(utf8);
+    return true;
+}
+
+bool jsonReader::readNumber(double &out)
+{
+    QByteArray text;
+    for(auto c = peek(); c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9'); c = m_buf.at(m_pos))
+    {
+        text += c;
+        m_pos++;
+        if(m_pos == m_buf.size() && !fill())
+            break;
+    }
+    bool ok = false;
+    out = text.toDouble(&ok);
+    return ok;
+}
+
+bool jsonReader::skipValue(int depth)
+{
+    if(depth > JSONMAXDEPTH)
+        return false;
+    auto c = peek();
+    if(c == '"')
+    {
+        QString str;
+        return readString(str);
+    }
+    if(c == '{' || c == '[')
+    {
+        auto close = c == '{' ? '}' : ']';
+        m_pos++;
+        if(expect(close))
+            return true;
+        do
+        {
+            if(c == '{')
+            {
+                QString key;
+                if(!readString(key) || !expect(':'))
+                    return false;
+            }
+            if(!skipValue(depth+1))
+                return false;
+        }while(expect(','));
+        return expect(close);
+    }
+    if(c == '-' || (c >= '0' && c <= '9'))
+    {
+        double number;
+        return readNumber(number);
+    }
+    //true, false, null
+    while(c >= 'a' && c <= 'z')
+    {
+        m_pos++;
+        c = m_pos < m_buf.size() ? m_buf.at(m_pos) : peek();
+    }
+    return true;
+}
+
+//a number that has to be an int, anything else fails the parse
+static bool readInt(jsonReader &reader, int &out)
+{
+    double number;
+    if(!reader.readNumber(number) || !(number >= INT_MIN && number <= INT_MAX) || number != int(number))
+        return false;
+    out = int(number);
+    return true;
+}
+
+//one {row,col,rowSpan,colSpan,val} object, read the way QJsonValue would:
+//a missing or mistyped member leaves 0 or an empty string, a number out of int range fails
+static bool readCellObject(jsonReader &reader, Cell &cell)
+{
+    cell.val = QString();
+    cell.row = cell.col = cell.rowSpan = cell.colSpan = 0;
+    if(!reader.expect('{'))
+        return false;
+    if(reader.expect('}'))
+        return true;
+    do
+    {
+        QString key;
+        if(!reader.readString(key) || !reader.expect(':'))
+            return false;
+        auto c = reader.peek();
+        if(c == '"' && key == "val")
+        {
+            if(!reader.readString(cell.val))
+                return false;
+            continue;
+        }
+        int *field = key == "row" ? &cell.row : key == "col" ? &cell.col :
+                     key == "rowSpan" ? &cell.rowSpan : key == "colSpan" ? &cell.colSpan : nullptr;
+        if(field && (c == '-' || (c >= '0' && c <= '9')))
+        {
+            if(!readInt(reader,*field))
+                return false;
+            continue;
+        }
+        if(!reader.skipValue())
+            return false;
+    }while(reader.expect(','));
+    return reader.expect('}');
+}
+
+//the cells array is read as it comes off the file and handed out in batches
+bool readJson(const QString &fileName, const cellBatch &batch, const ioProgress &progress, QSize *extent)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qCWarning(lcIO) << "Open json file failed!";
+        return false;
+    }
+
+    auto total = file.size();
+    jsonReader reader(&file);
+    QList<Cell> cells;
+    auto flush = [&]{
+        if(cells.isEmpty())
+            return true;
+        bool more = batch(cells) && ioReport(progress,reader.consumed(),total);
+        cells.clear();
+        return more;
+    };
+
+    bool ok = reader.expect('{');
+    if(ok && !reader.expect('}'))
+    {
+        do
+        {
+            QString key;
+            ok = reader.readString(key) && reader.expect(':');
+            if(ok && key == "cells" && reader.expect('['))
+            {
+                if(reader.expect(']'))
+                    continue;
+                do
+                {
+                    Cell cell;
+                    ok = readCellObject(reader,cell);
+                    if(!ok)
+                        break;
+                    cells.append(cell);
+                    if(cells.size() == IOCHUNKSIZE && !flush())
+                        return false;
+                }while(reader.expect(','));
+                ok = ok && reader.expect(']');
+            }
+            else if(ok && extent && (key == "cols" || key == "rows") && reader.peek() >= '0' && reader.peek() <= '9')
+            {
+                int number = 0;
+                ok = readInt(reader,number);
+                if(key == "cols")
+                    extent->setWidth(number);
+                else
+                    extent->setHeight(number);
+            }
+            else if(ok)
+                ok = reader.skipValue();
+        }while(ok && reader.expect(','));
+        ok = ok && reader.expect('}');
+    }
+    if(!ok)
+    {
+        qCWarning(lcIO) << "Malformed json at byte" << reader.consumed();
+        return false;
+    }
+    return flush() && ioReport(progress,total,total);
+}
+
+bool readJson(const QString &fileName, TableState &state, const ioProgress &progress)
+{
+    QSize extent(-1,-1);
+    bool ok = readJson(fileName,[&state](QList<Cell> &cells){
+        for(auto &&cell : cells)
+            state.cells.append(cell);
+        return true;
+    },progress,&extent);
+    if(ok && (extent.width() >= 0 || extent.height() >= 0))
+    {
+        state.sparse = true;
+        state.colMap.reset(qMax(extent.width(),0));
+        state.rowMap.reset(qMax(extent.height(),0));
+    }
+    return ok;
+}
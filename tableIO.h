@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QSize>
+#include <functional>
+#include "mergeModel.h"
+
+// Reading and writing a TableState away from the model, so it can run on a
+// worker thread against a snapshot. Loaded cells carry their positions in
+// row/col, mergeModel::adoptAxes turns them into ids. SQLite tables are in tableDb.
+
+//rows per execBatch or JSON batch, and how often progress is reported
+#define IOCHUNKSIZE 1000
+
+//called with (done,total) while working, returning false cancels. Counts are
+//cells or bytes, so a large file does not fit an int
+using ioProgress = std::function<bool(qint64,qint64)>;
+//passes (done,total) on, false once the job should stop
+bool ioReport(const ioProgress &progress, qint64 done, qint64 total);
+
+//called with each batch of cells parsed, returning false cancels
+using cellBatch = std::function<bool(QList<Cell>&)>;
+
+//JSON is written and read as a stream, without building the document in memory
+bool writeJson(const QString &fileName, const TableState &state, const ioProgress &progress = {});
+//extent gets the (cols,rows) a sparse table was saved with, a dense one leaves it alone
+bool readJson(const QString &fileName, const cellBatch &batch, const ioProgress &progress = {},
+              QSize *extent = nullptr);
+bool readJson(const QString &fileName, TableState &state, const ioProgress &progress = {});
+
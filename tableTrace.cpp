@@ -0,0 +1,160 @@
+#include "tableTrace.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+
+Q_LOGGING_CATEGORY(lcModel,"mergetable.model")
+Q_LOGGING_CATEGORY(lcIO,"mergetable.io")
+Q_LOGGING_CATEGORY(lcDump,"mergetable.dump",QtInfoMsg)
+Q_LOGGING_CATEGORY(lcTiming,"mergetable.timing",QtWarningMsg)
+
+QAtomicInt tableTrace::s_active;
+QAtomicInteger<qint64> tableTrace::s_counters[tableTrace::CounterCount];
+
+namespace {
+
+//a finished span with the counters as they were at its end
+struct TraceEvent {
+    const char *name;
+    qint64 begin;
+    qint64 end;
+    int thread;
+    qint64 counters[tableTrace::CounterCount];
+};
+
+struct TraceLog {
+    QMutex lock;
+    QList<TraceEvent> events;
+    QHash<Qt::HANDLE,int> threads;      //small numbers for the trace viewer
+    QString fileName;                   //written at exit, from MERGETABLE_TRACE
+};
+
+TraceLog &traceLog()
+{
+    static TraceLog log;
+    return log;
+}
+
+const char *counterNames[] = {"cellsTouched", "findProbes", "bytesSnapshotted"};
+
+}
+
+qint64 tableTrace::now()
+{
+    static QElapsedTimer clock = []{ QElapsedTimer t; t.start(); return t; }();
+    return clock.nsecsElapsed();
+}
+
+void tableTrace::start()
+{
+    now();
+    s_active.storeRelaxed(1);
+}
+
+void tableTrace::stop()
+{
+    s_active.storeRelaxed(0);
+}
+
+void tableTrace::reset()
+{
+    auto &log = traceLog();
+    QMutexLocker locker(&log.lock);
+    log.events.clear();
+    for(auto &counter : s_counters)
+        counter.storeRelaxed(0);
+}
+
+void tableTrace::record(const char *name, qint64 begin, qint64 end)
+{
+    auto &log = traceLog();
+    QMutexLocker locker(&log.lock);
+    if(log.events.size() >= TRACEEVENTS)
+        return;
+    auto thread = log.threads.value(QThread::currentThreadId(),-1);
+    if(thread < 0)
+    {
+        thread = log.threads.size()+1;
+        log.threads.insert(QThread::currentThreadId(),thread);
+    }
+    TraceEvent event{name,begin,end,thread,{}};
+    for(int i = 0; i < CounterCount; i++)
+        event.counters[i] = s_counters[i].loadRelaxed();
+    log.events.append(event);
+}
+
+//complete events ("X") for the spans, one counter event ("C") at the end of each
+bool tableTrace::writeChromeTrace(const QString &fileName)
+{
+    auto &log = traceLog();
+    QMutexLocker locker(&log.lock);
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCWarning(lcModel) << "Couldn't open" << fileName << "for the trace";
+        return false;
+    }
+    auto pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray out = "{\"traceEvents\":[\n";
+    for(int i = 0; i < log.events.size(); i++)
+    {
+        const auto &event = log.events.at(i);
+        auto tid = QByteArray::number(event.thread);
+        if(i > 0)
+            out += ",\n";
+        out += "{\"name\":\"" + QByteArray(event.name) + "\",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + tid +
+               ",\"ts\":" + QByteArray::number(event.begin/1000.0,'f',3) +
+               ",\"dur\":" + QByteArray::number((event.end-event.begin)/1000.0,'f',3) + "},\n";
+        out += "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":" + pid +
+               ",\"ts\":" + QByteArray::number(event.end/1000.0,'f',3) + ",\"args\":{";
+        for(int c = 0; c < CounterCount; c++)
+            out += (c ? ",\"" : "\"") + QByteArray(counterNames[c]) + "\":" + QByteArray::number(event.counters[c]);
+        out += "}}";
+        if(out.size() > (1 << 20))
+        {
+            file.write(out);
+            out.clear();
+        }
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    file.write(out);
+    if(!file.commit())
+    {
+        qCWarning(lcModel) << "Failed to write the trace:" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void tableTrace::startFromEnvironment()
+{
+    auto fileName = qEnvironmentVariable("MERGETABLE_TRACE");
+    if(fileName.isEmpty())
+        return;
+    traceLog().fileName = fileName;
+    start();
+    qAddPostRoutine([]{
+        stop();
+        writeChromeTrace(traceLog().fileName);
+    });
+}
+
+traceScope::traceScope(const char *name)
+    : m_name(name)
+{
+    if(tableTrace::isActive() || lcTiming().isInfoEnabled())
+        m_begin = tableTrace::now();
+}
+
+traceScope::~traceScope()
+{
+    if(m_begin < 0)
+        return;
+    auto end = tableTrace::now();
+    if(tableTrace::isActive())
+        tableTrace::record(m_name,m_begin,end);
+    qCInfo(lcTiming).nospace() << m_name << ": " << (end-m_begin)/1000 << " us";
+}
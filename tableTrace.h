@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QLoggingCategory>
+#include <QAtomicInteger>
+#include <QString>
+
+// Logging and profiling of the model.
+//
+// Messages go through the categories below. Only debug builds keep the
+// qCDebug lines, mergecore is built with QT_NO_DEBUG_OUTPUT otherwise. Two of
+// the categories stay quiet until enabled, as in
+//   QT_LOGGING_RULES="mergetable.dump.debug=true"
+// since they cost more than the edits they describe on a large table. The
+// timings are logged at info level, so they can be turned on in release
+// builds too, with "mergetable.timing=true".
+Q_DECLARE_LOGGING_CATEGORY(lcModel)     //mergetable.model: edits, failures
+Q_DECLARE_LOGGING_CATEGORY(lcIO)        //mergetable.io: loads and saves
+Q_DECLARE_LOGGING_CATEGORY(lcDump)      //mergetable.dump: every cell after each edit, off by default
+Q_DECLARE_LOGGING_CATEGORY(lcTiming)    //mergetable.timing: each traced operation and its time, off by default
+
+#define TRACEEVENTS 1000000     //spans kept while tracing, later ones are dropped
+
+// Spans of the model's operations and counters of the work they did,
+// recorded only between start() and stop(). With MERGETABLE_TRACE=<file>
+// in the environment the app and the cli trace the whole session and write
+// it as a Chrome trace (chrome://tracing, ui.perfetto.dev) when they quit.
+class tableTrace
+{
+public:
+    enum Counter {
+        CellsTouched,       //cells added, changed or removed
+        FindProbes,         //lookups of a cell by position
+        BytesSnapshotted,   //table state handed to a worker thread
+        CounterCount
+    };
+
+    static void start();
+    static void stop();
+    static bool isActive() { return s_active.loadRelaxed(); }
+    static void count(Counter counter, qint64 n = 1)
+    {
+        if(isActive())
+            s_counters[counter].fetchAndAddRelaxed(n);
+    }
+    static qint64 counter(Counter counter) { return s_counters[counter].loadRelaxed(); }
+    //drops the recorded spans and zeroes the counters
+    static void reset();
+    static bool writeChromeTrace(const QString &fileName);
+    static void startFromEnvironment();
+
+private:
+    friend class traceScope;
+    static qint64 now();
+    static void record(const char *name, qint64 begin, qint64 end);
+
+    static QAtomicInt s_active;
+    static QAtomicInteger<qint64> s_counters[CounterCount];
+};
+
+//times the enclosing block: a span while tracing, a line in mergetable.timing
+class traceScope
+{
+public:
+    explicit traceScope(const char *name);
+    ~traceScope();
+    traceScope(const traceScope &) = delete;
+    traceScope &operator=(const traceScope &) = delete;
+
+private:
+    const char *m_name;
+    qint64 m_begin = -1;    //ns, -1 when nobody looks
+};
+
+#define TRACE_SCOPE(name) traceScope traceScope_(name)
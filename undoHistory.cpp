@@ -0,0 +1,240 @@
+#include "undoHistory.h"
+#include "tableTrace.h"
+#include <QDataStream>
+#include <QTemporaryFile>
+
+static void writeCells(QDataStream &out, const QList<Cell> &cells)
+{
+    out << qint32(cells.size());
+    for(const auto &cell : cells)
+        out << cell.val << qint32(cell.rowSpan) << qint32(cell.colSpan) << qint32(cell.row) << qint32(cell.col) << qint32(cell.id);
+}
+
+static void readCells(QDataStream &in, QList<Cell> &cells)
+{
+    qint32 n = 0;
+    in >> n;
+    cells.resize(n);
+    for(auto &cell : cells)
+    {
+        qint32 rowSpan, colSpan, row, col, id;
+        in >> cell.val >> rowSpan >> colSpan >> row >> col >> id;
+        cell.rowSpan = rowSpan;
+        cell.colSpan = colSpan;
+        cell.row = row;
+        cell.col = col;
+        cell.id = id;
+    }
+}
+
+static void writeCommand(QDataStream &out, const TableCommand &cmd)
+{
+    out << qint32(cmd.type) << qint32(cmd.row) << qint32(cmd.col) << qint32(cmd.count)
+        << qint32(cmd.rowSpan) << qint32(cmd.colSpan) << cmd.before << cmd.after;
+    writeCells(out,cmd.removed);
+    writeCells(out,cmd.resized);
+    out << qint32(cmd.children.size());
+    for(const auto &child : cmd.children)
+        writeCommand(out,child);
+}
+
+static void readCommand(QDataStream &in, TableCommand &cmd)
+{
+    qint32 type, row, col, count, rowSpan, colSpan, children = 0;
+    in >> type >> row >> col >> count >> rowSpan >> colSpan >> cmd.before >> cmd.after;
+    cmd.type = TableCommand::Type(type);
+    cmd.row = row;
+    cmd.col = col;
+    cmd.count = count;
+    cmd.rowSpan = rowSpan;
+    cmd.colSpan = colSpan;
+    readCells(in,cmd.removed);
+    readCells(in,cmd.resized);
+    in >> children;
+    cmd.children.resize(children);
+    for(auto &child : cmd.children)
+        readCommand(in,child);
+}
+
+undoHistory::undoHistory() = default;
+
+undoHistory::~undoHistory() = default;
+
+qint64 undoHistory::commandBytes(const TableCommand &cmd)
+{
+    auto cellBytes = [](const QList<Cell> &cells){
+        qint64 bytes = cells.size()*qint64(sizeof(Cell));
+        for(const auto &cell : cells)
+            bytes += cell.val.size()*qint64(sizeof(QChar));
+        return bytes;
+    };
+    qint64 bytes = sizeof(TableCommand) + (cmd.before.size()+cmd.after.size())*qint64(sizeof(QChar))
+                   + cellBytes(cmd.removed) + cellBytes(cmd.resized);
+    for(const auto &child : cmd.children)
+        bytes += commandBytes(child);
+    return bytes;
+}
+
+void undoHistory::setBudget(qint64 bytes)
+{
+    m_budget = bytes;
+    trim();
+}
+
+void undoHistory::push(const TableCommand &cmd)
+{
+    Entry entry;
+    entry.cmd = cmd;
+    entry.bytes = commandBytes(cmd);
+    m_bytes += entry.bytes;
+    m_entries.append(std::move(entry));
+    trim();
+}
+
+TableCommand &undoHistory::last()
+{
+    auto &entry = m_entries.last();
+    if(m_entries.size() <= m_packedEnd)
+        unpack(entry);
+    return entry.cmd;
+}
+
+TableCommand undoHistory::takeLast()
+{
+    last();
+    auto entry = m_entries.takeLast();
+    m_bytes -= entry.bytes;
+    return std::move(entry.cmd);
+}
+
+QList<TableCommand> undoHistory::takeAll()
+{
+    QList<TableCommand> cmds;
+    while(!isEmpty())
+        cmds.prepend(takeLast());
+    return cmds;
+}
+
+void undoHistory::clear()
+{
+    m_entries.clear();
+    m_spilledEnd = 0;
+    m_packedEnd = 0;
+    m_bytes = 0;
+    m_spilled = 0;
+    m_spillStart = 0;
+    if(m_spill)
+        m_spill->resize(0);
+}
+
+//oldest first: pack what is still as it is, spill what is packed, then drop
+void undoHistory::trim()
+{
+    while(m_bytes > m_budget && m_packedEnd < m_entries.size()-1)
+        pack(m_entries[m_packedEnd++]);
+    while(m_bytes > m_budget && m_spilledEnd < m_packedEnd)
+    {
+        if(!spill(m_entries[m_spilledEnd]))
+        {
+            dropFirst();
+            continue;
+        }
+        m_spilledEnd++;
+    }
+    while(m_spilled > UNDOSPILL)
+        dropFirst();
+}
+
+void undoHistory::pack(Entry &entry)
+{
+    TRACE_SCOPE("packUndo");
+    QByteArray raw;
+    QDataStream out(&raw,QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    writeCommand(out,entry.cmd);
+    entry.packed = qCompress(raw);
+    entry.cmd = TableCommand();
+    m_bytes += entry.packed.size() - entry.bytes;
+}
+
+bool undoHistory::spill(Entry &entry)
+{
+    if(!m_spill)
+    {
+        m_spill.reset(new QTemporaryFile);
+        if(!m_spill->open())
+        {
+            qCWarning(lcModel) << "Couldn't open a file for the undo history:" << m_spill->errorString();
+            m_spill.reset();
+            return false;
+        }
+    }
+    auto offset = m_spillStart + m_spilled;
+    if(!m_spill->seek(offset) || m_spill->write(entry.packed) != entry.packed.size())
+    {
+        qCWarning(lcModel) << "Failed to write the undo history:" << m_spill->errorString();
+        return false;
+    }
+    entry.offset = offset;
+    entry.length = entry.packed.size();
+    m_bytes -= entry.length;
+    m_spilled += entry.length;
+    entry.packed = QByteArray();
+    return true;
+}
+
+void undoHistory::unpack(Entry &entry)
+{
+    TRACE_SCOPE("unpackUndo");
+    if(entry.offset >= 0)
+    {
+        //the newest spilled entry ends the file
+        m_spill->seek(entry.offset);
+        entry.packed = m_spill->read(entry.length);
+        m_spilled -= entry.length;
+        m_spill->resize(entry.offset);
+        entry.offset = -1;
+        m_spilledEnd--;
+        m_bytes += entry.packed.size();
+        if(m_spillStart > m_spilled)
+            compactSpill();
+    }
+    QDataStream in(qUncompress(entry.packed));
+    in.setVersion(QDataStream::Qt_6_0);
+    readCommand(in,entry.cmd);
+    m_bytes += entry.bytes - entry.packed.size();
+    entry.packed = QByteArray();
+    m_packedEnd--;
+}
+
+void undoHistory::dropFirst()
+{
+    const auto &entry = m_entries.first();
+    if(m_spilledEnd > 0)
+    {
+        m_spilled -= entry.length;
+        m_spillStart += entry.length;
+        m_spilledEnd--;
+    }else
+        m_bytes -= m_packedEnd > 0 ? entry.packed.size() : entry.bytes;
+    if(m_packedEnd > 0)
+        m_packedEnd--;
+    m_entries.removeFirst();
+    if(m_spillStart > m_spilled)
+        compactSpill();
+}
+
+//moves the live history to the start of the file once the dropped part outweighs it
+void undoHistory::compactSpill()
+{
+    if(!m_spill)
+        return;
+    m_spill->seek(m_spillStart);
+    auto live = m_spill->read(m_spilled);
+    m_spill->resize(0);
+    m_spill->seek(0);
+    m_spill->write(live);
+    for(qsizetype i = 0; i < m_spilledEnd; i++)
+        m_entries[i].offset -= m_spillStart;
+    m_spillStart = 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QList>
+#include <QByteArray>
+#include <memory>
+#include "cellStore.h"
+
+class QTemporaryFile;
+
+#define UNDOBUDGET (32*1024*1024)           //bytes each of the undo and redo stacks keeps in memory
+#define UNDOSPILL (512LL*1024*1024)         //bytes of history kept in the temp file before the oldest is dropped
+
+//one undoable edit, keeping only what it changed. Cells recorded here hold
+//logical positions in row/col: physical ids do not survive an undo
+struct TableCommand {
+    enum Type { SetValue, InsertRows, RemoveRows, InsertColumns, RemoveColumns, Merge, Split, Group };
+    Type type = SetValue;
+    int row = 0;
+    int col = 0;
+    int count = 1;      //rows or columns inserted/removed
+    int rowSpan = 1;    //merged/split area
+    int colSpan = 1;
+    QString before;
+    QString after;
+    QList<Cell> removed;    //cells the edit deleted
+    QList<Cell> resized;    //cells the edit shrank, as they were before
+    QList<TableCommand> children;   //Group: done in order, undone backwards
+};
+
+// A stack of commands held within a byte budget. Past it the oldest commands
+// are compressed, then written to a temp file, and only dropped once the file
+// holds UNDOSPILL bytes. The newest command always stays as it is, whatever
+// its size; any other is unpacked again when it becomes the newest.
+class undoHistory
+{
+public:
+    undoHistory();
+    ~undoHistory();
+    undoHistory(const undoHistory &) = delete;
+    undoHistory &operator=(const undoHistory &) = delete;
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+
+    void push(const TableCommand &cmd);
+    TableCommand &last();
+    TableCommand takeLast();
+    //oldest first
+    QList<TableCommand> takeAll();
+    void clear();
+    qsizetype size() const { return m_entries.size(); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+
+    //estimated memory, packed commands at their compressed size
+    qint64 bytes() const { return m_bytes; }
+    //written out to the temp file
+    qint64 spilledBytes() const { return m_spilled; }
+
+    static qint64 commandBytes(const TableCommand &cmd);
+
+private:
+    //the commands are stacked spilled, then packed, then as they are
+    struct Entry {
+        TableCommand cmd;
+        QByteArray packed;      //compressed, while packed
+        qint64 offset = -1;     //in the temp file, once spilled
+        qint64 length = 0;      //of the spilled bytes
+        qint64 bytes = 0;       //estimated memory of cmd
+    };
+    void trim();
+    void pack(Entry &entry);
+    bool spill(Entry &entry);
+    void unpack(Entry &entry);
+    void dropFirst();
+    void compactSpill();
+
+    QList<Entry> m_entries;
+    qsizetype m_spilledEnd = 0;     //entries before this are in the temp file
+    qsizetype m_packedEnd = 0;      //and before this compressed at least
+    qint64 m_budget = UNDOBUDGET;
+    qint64 m_bytes = 0;
+    qint64 m_spilled = 0;           //live bytes of the temp file
+    qint64 m_spillStart = 0;        //where they start, the rest before is dropped history
+    std::unique_ptr<QTemporaryFile> m_spill;    //opened on the first spill
+};
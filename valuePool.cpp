@@ -0,0 +1,76 @@
+#include "valuePool.h"
+
+int valuePool::intern(const QString &val)
+{
+    auto id = m_ids.value(val,-1);
+    if(id >= 0)
+    {
+        m_refs[id]++;
+        return id;
+    }
+    id = hold(val);
+    m_ids.insert(val,id);
+    return id;
+}
+
+int valuePool::hold(const QString &val)
+{
+    int id;
+    if(!m_free.isEmpty())
+    {
+        id = m_free.takeLast();
+        m_values[id] = val;
+        m_refs[id] = 1;
+    }else
+    {
+        id = m_values.size();
+        m_values.append(val);
+        m_refs.append(1);
+    }
+    m_chars += val.size();
+    return id;
+}
+
+void valuePool::release(int id)
+{
+    if(--m_refs[id] > 0)
+        return;
+    //a held value may equal an interned one, only its own entry goes
+    if(m_ids.value(m_values.at(id),-1) == id)
+        m_ids.remove(m_values.at(id));
+    m_chars -= m_values.at(id).size();
+    m_values[id] = QString();
+    m_free.append(id);
+}
+
+QVector<int> valuePool::compact()
+{
+    QVector<int> remap(m_values.size(),-1);
+    QVector<QString> values;
+    QVector<int> refs;
+    values.reserve(size());
+    refs.reserve(size());
+    for(int id = 0; id < m_values.size(); id++)
+    {
+        if(m_refs.at(id) == 0)
+            continue;
+        remap[id] = values.size();
+        if(m_ids.value(m_values.at(id),-1) == id)
+            m_ids.insert(m_values.at(id),values.size());
+        values.append(m_values.at(id));
+        refs.append(m_refs.at(id));
+    }
+    m_values = values;
+    m_refs = refs;
+    m_free.clear();
+    return remap;
+}
+
+void valuePool::clear()
+{
+    m_values.clear();
+    m_refs.clear();
+    m_ids.clear();
+    m_free.clear();
+    m_chars = 0;
+}
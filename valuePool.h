@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QVector>
+#include <QString>
+#include <QHash>
+
+#define VALUEPOOLSLACK 1024     //free slots kept before compaction is worth it
+
+// Interned cell values: every distinct string is kept once and handed out
+// as an int id, counted by how many cells use it. Released ids are reused,
+// compact() renumbers the live ones once too many slots stand free. Values
+// held rather than interned get a slot of their own and are never looked up.
+class valuePool
+{
+public:
+    //the id of val, adding it if new; each call takes a reference
+    int intern(const QString &val);
+    //a slot of val's own, not hashed nor shared: for values read from a
+    //mapping, which are only interned once edited
+    int hold(const QString &val);
+    void retain(int id, int count = 1) { m_refs[id] += count; }
+    //drops a reference, the value goes with the last one
+    void release(int id);
+    const QString &value(int id) const { return m_values.at(id); }
+
+    int size() const { return m_values.size() - m_free.size(); }
+    bool wasteful() const { return m_free.size() > qMax(VALUEPOOLSLACK,size()); }
+    //estimated memory of the values, the lookup hash included
+    qint64 bytes() const
+    {
+        return m_chars*qint64(sizeof(QChar)) + m_values.size()*qint64(sizeof(QString)+sizeof(int))
+               + m_ids.size()*qint64(sizeof(QString)+sizeof(int)+sizeof(void*));
+    }
+    //packs the live values, returns the new id of every old one (-1 if freed)
+    QVector<int> compact();
+    void clear();
+
+private:
+    QVector<QString> m_values;
+    QVector<int> m_refs;
+    QHash<QString,int> m_ids;
+    QVector<int> m_free;
+    qint64 m_chars = 0;     //of the live values
+};